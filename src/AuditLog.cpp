@@ -0,0 +1,350 @@
+#include "AuditLog.h"
+
+#include <QtCore/qcoreapplication.h>
+#include <QtCore/qdatetime.h>
+#include <QtCore/qdir.h>
+#include <QtCore/qfileinfo.h>
+#include <chrono>
+#include <cstring>
+
+static const char FILE_MAGIC[8] = {'R','L','C','A','U','D','I','T'};
+static const size_t FILE_HEADER_SIZE = 16;
+static const size_t BLOCK_HEADER_SIZE = 24;
+static const size_t MAX_BLOCK_RECORDS = 1024;
+
+static const char* sourceName(quint8 source) {
+	switch(static_cast<AuditSource>(source)) {
+	case AuditSource::GUI:
+		return "gui";
+	case AuditSource::BATCH:
+		return "batch";
+	case AuditSource::WATCH:
+		return "watch";
+	case AuditSource::WORKSHEET:
+		return "worksheet";
+	}
+	return "unknown";
+}
+
+struct BlockHeader {
+	quint32 magic;
+	quint32 count;
+	quint64 dropped;
+	quint32 crc;
+	quint32 reserved;
+};
+
+AuditLog::AuditLog(size_t capacity)
+	: buffer(capacity), session(0), sequence(0), dropped(0), ruleSetHash(0), running(false), failed(false), settled(0), lost(0) {
+	this->pending.reserve(MAX_BLOCK_RECORDS);
+}
+
+AuditLog::~AuditLog(void) {
+	this->close();
+}
+
+bool AuditLog::open(const QString &path) {
+	this->close();
+
+	QFileInfo info(path);
+	QDir().mkpath(info.absolutePath());
+
+	this->file.setFileName(path);
+	if(!this->file.open(QIODevice::ReadWrite)) {
+		this->error = QString("Cannot open audit log %1.\n%2").arg(path).arg(this->file.errorString());
+		return false;
+	}
+
+	if(this->file.size() == 0) {
+		char header[FILE_HEADER_SIZE];
+		quint32 version = FORMAT_VERSION;
+		quint32 recordSize = sizeof(AuditRecord);
+		memcpy(header, FILE_MAGIC, 8);
+		memcpy(header + 8, &version, 4);
+		memcpy(header + 12, &recordSize, 4);
+		if(this->file.write(header, FILE_HEADER_SIZE) != (qint64)FILE_HEADER_SIZE) {
+			this->error = QString("Cannot write audit log %1.\n%2").arg(path).arg(this->file.errorString());
+			this->file.close();
+			return false;
+		}
+	} else {
+		char header[FILE_HEADER_SIZE];
+		quint32 version, recordSize;
+		if(this->file.read(header, FILE_HEADER_SIZE) != (qint64)FILE_HEADER_SIZE || memcmp(header, FILE_MAGIC, 8) != 0) {
+			this->error = QString("%1 is not an audit log.").arg(path);
+			this->file.close();
+			return false;
+		}
+		memcpy(&version, header + 8, 4);
+		memcpy(&recordSize, header + 12, 4);
+		if(version != FORMAT_VERSION || recordSize != sizeof(AuditRecord)) {
+			this->error = QString("The audit log %1 has an incompatible format (version %2).").arg(path).arg(version);
+			this->file.close();
+			return false;
+		}
+	}
+	this->file.seek(this->file.size());
+	this->file.flush();
+
+	// sequence numbers restart with every process, the session tells the runs apart
+	qint64 started = QDateTime::currentMSecsSinceEpoch();
+	qint64 pid = QCoreApplication::applicationPid();
+	QByteArray seed(reinterpret_cast<const char*>(&started), sizeof(started));
+	seed.append(reinterpret_cast<const char*>(&pid), sizeof(pid));
+	this->session = hash(seed);
+	this->sequence.store(0);
+	this->settled.store(0);
+	this->failed.store(false);
+	this->lost = 0;
+	{
+		std::lock_guard<std::mutex> lock(this->errorMutex);
+		this->error = QString();
+	}
+
+	this->running.store(true);
+	this->writer = std::thread(&AuditLog::writerLoop, this);
+	return true;
+}
+
+void AuditLog::close() {
+	if(this->running.exchange(false)) {
+		this->wake.notify_one();
+		this->writer.join();
+	}
+	if(this->file.isOpen()) {
+		this->file.close();
+	}
+}
+
+QString AuditLog::errorString() const {
+	std::lock_guard<std::mutex> lock(this->errorMutex);
+	return this->error;
+}
+
+bool AuditLog::flush() {
+	const quint64 queued = this->sequence.load();
+	while(this->running.load() && this->settled.load() < queued) {
+		this->wake.notify_one();
+		std::unique_lock<std::mutex> lock(this->spaceMutex);
+		this->space.wait_for(lock, std::chrono::milliseconds(10));
+	}
+	return !this->failed.load();
+}
+
+void AuditLog::record(AuditRecord &record) {
+	if(!this->running.load(std::memory_order_relaxed)) {
+		return;
+	}
+	record.timestamp = QDateTime::currentMSecsSinceEpoch();
+	record.session = this->session;
+	record.sequence = this->sequence.fetch_add(1, std::memory_order_relaxed);
+	record.ruleSetHash = this->ruleSetHash.load(std::memory_order_relaxed);
+	while(!this->buffer.push(record)) {
+		this->wake.notify_one();
+		if(record.source == static_cast<quint8>(AuditSource::GUI) || !this->running.load()) {
+			// never stall the window, the gap is recorded in the next block
+			this->dropped.fetch_add(1, std::memory_order_relaxed);
+			this->settled.fetch_add(1);
+			return;
+		}
+		// batch producers wait until the writer has drained the buffer
+		std::unique_lock<std::mutex> lock(this->spaceMutex);
+		this->space.wait_for(lock, std::chrono::milliseconds(10));
+	}
+	if(this->buffer.size() > this->buffer.capacity() / 2) {
+		this->wake.notify_one();
+	}
+}
+
+void AuditLog::writerLoop() {
+	while(this->running.load()) {
+		{
+			std::unique_lock<std::mutex> lock(this->wakeMutex);
+			this->wake.wait_for(lock, std::chrono::milliseconds(250));
+		}
+		this->flushPending();
+	}
+	this->flushPending();
+}
+
+void AuditLog::flushPending() {
+	AuditRecord record;
+	bool more = true;
+	while(more) {
+		this->pending.clear();
+		while(this->pending.size() < MAX_BLOCK_RECORDS && this->buffer.pop(record)) {
+			this->pending.push_back(record);
+		}
+		more = this->pending.size() == MAX_BLOCK_RECORDS;
+		if(!this->pending.empty()) {
+			this->space.notify_all();
+		}
+
+		quint64 dropped = this->dropped.exchange(0);
+		if(this->pending.empty() && dropped == 0) {
+			return;
+		}
+
+		const char *payload = reinterpret_cast<const char*>(this->pending.data());
+		size_t payloadSize = this->pending.size() * sizeof(AuditRecord);
+
+		BlockHeader header;
+		header.magic = BLOCK_MAGIC;
+		header.count = static_cast<quint32>(this->pending.size());
+		header.dropped = dropped;
+		header.crc = crc32(reinterpret_cast<const char*>(&header.dropped), sizeof(header.dropped));
+		header.crc = crc32(payload, payloadSize, header.crc);
+		header.reserved = 0;
+
+		const qint64 start = this->file.pos();
+		const bool written = this->file.write(reinterpret_cast<const char*>(&header), BLOCK_HEADER_SIZE) == (qint64)BLOCK_HEADER_SIZE
+			&& this->file.write(payload, payloadSize) == (qint64)payloadSize
+			&& this->file.flush();
+		if(!written) {
+			// cut off the partial block; the lost records go into the dropped counter of the next block that can be written
+			const QString message = this->file.errorString();
+			this->file.resize(start);
+			this->file.seek(start);
+			this->dropped.fetch_add(dropped + this->pending.size());
+			this->lost += this->pending.size();
+			{
+				std::lock_guard<std::mutex> lock(this->errorMutex);
+				this->error = QString("Cannot write the audit log %1, %2 records were not recorded.\n%3")
+					.arg(this->file.fileName()).arg(this->lost).arg(message);
+			}
+			this->failed.store(true);
+		}
+		this->settled.fetch_add(this->pending.size());
+		this->space.notify_all();
+	}
+}
+
+quint64 AuditLog::hash(const QByteArray &data, quint64 seed) {
+	quint64 h = seed;
+	for(int i = 0; i < data.size(); ++i) {
+		h ^= static_cast<unsigned char>(data.at(i));
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+quint32 AuditLog::crc32(const char *data, size_t length, quint32 crc) {
+	struct Table {
+		Table() {
+			for(quint32 i = 0; i < 256; ++i) {
+				quint32 c = i;
+				for(int k = 0; k < 8; ++k) {
+					c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+				}
+				entries[i] = c;
+			}
+		}
+		quint32 entries[256];
+	};
+	static const Table table;
+
+	crc = ~crc;
+	for(size_t i = 0; i < length; ++i) {
+		crc = table.entries[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+bool AuditLogReader::read(const QString &path) {
+	this->records.clear();
+	this->corruptBlocks = 0;
+	this->droppedRecords = 0;
+
+	QFile file(path);
+	if(!file.open(QIODevice::ReadOnly)) {
+		this->error = QString("Cannot open audit log %1.\n%2").arg(path).arg(file.errorString());
+		return false;
+	}
+	QByteArray data = file.readAll();
+	file.close();
+
+	if(data.size() < (int)FILE_HEADER_SIZE || memcmp(data.constData(), FILE_MAGIC, 8) != 0) {
+		this->error = QString("%1 is not an audit log.").arg(path);
+		return false;
+	}
+	quint32 version, recordSize;
+	memcpy(&version, data.constData() + 8, 4);
+	memcpy(&recordSize, data.constData() + 12, 4);
+	if(version != AuditLog::FORMAT_VERSION || recordSize != sizeof(AuditRecord)) {
+		this->error = QString("The audit log %1 has an incompatible format (version %2).").arg(path).arg(version);
+		return false;
+	}
+
+	size_t pos = FILE_HEADER_SIZE;
+	const size_t end = data.size();
+	while(pos + BLOCK_HEADER_SIZE <= end) {
+		BlockHeader header;
+		memcpy(&header, data.constData() + pos, BLOCK_HEADER_SIZE);
+		size_t payloadSize = (size_t)header.count * sizeof(AuditRecord);
+
+		bool valid = header.magic == AuditLog::BLOCK_MAGIC
+			&& header.count <= MAX_BLOCK_RECORDS
+			&& pos + BLOCK_HEADER_SIZE + payloadSize <= end;
+		if(valid) {
+			const char *payload = data.constData() + pos + BLOCK_HEADER_SIZE;
+			quint32 crc = AuditLog::crc32(reinterpret_cast<const char*>(&header.dropped), sizeof(header.dropped));
+			crc = AuditLog::crc32(payload, payloadSize, crc);
+			if(crc == header.crc) {
+				size_t offset = this->records.size();
+				this->records.resize(offset + header.count);
+				memcpy(this->records.data() + offset, payload, payloadSize);
+				this->droppedRecords += header.dropped;
+				pos += BLOCK_HEADER_SIZE + payloadSize;
+				continue;
+			}
+		}
+
+		// damaged block: resynchronize on the next block magic
+		++this->corruptBlocks;
+		++pos;
+		while(pos + BLOCK_HEADER_SIZE <= end) {
+			quint32 magic;
+			memcpy(&magic, data.constData() + pos, 4);
+			if(magic == AuditLog::BLOCK_MAGIC) break;
+			++pos;
+		}
+		if(pos + BLOCK_HEADER_SIZE > end) {
+			pos = end;
+		}
+	}
+	if(pos != end) {
+		// truncated tail, e.g. after a crash during a write
+		++this->corruptBlocks;
+	}
+	return true;
+}
+
+void AuditLogReader::exportCsv(QTextStream &out) const {
+	out << "session;sequence;timestamp;source;rule set;rule;declared;unit;density;homogenous;precision;outputs";
+	for(int i = 0; i < AUDIT_MAX_OUTPUTS; ++i) {
+		out << ";g/l #" << i + 1 << ";% w/w #" << i + 1;
+	}
+	out << "\n";
+
+	for(auto it = this->records.begin(); it != this->records.end(); ++it) {
+		out << QString::number(it->session, 16).rightJustified(16, '0') << ";"
+			<< it->sequence << ";"
+			<< QDateTime::fromMSecsSinceEpoch(it->timestamp).toUTC().toString(Qt::ISODate) << ";"
+			<< sourceName(it->source) << ";"
+			<< QString::number(it->ruleSetHash, 16).rightJustified(16, '0') << ";"
+			<< QString::number(it->ruleNameHash, 16).rightJustified(16, '0') << ";"
+			<< QString::number(it->declared, 'g', 17) << ";"
+			<< (it->declaredUnit == 0 ? "%w/w" : "g/l") << ";"
+			<< QString::number(it->density, 'g', 17) << ";"
+			<< (it->homogenous ? "homogenous" : "heterogenous") << ";"
+			<< static_cast<unsigned int>(it->precision) << ";"
+			<< static_cast<unsigned int>(it->outputCount);
+		for(int i = 0; i < AUDIT_MAX_OUTPUTS; ++i) {
+			out << ";";
+			if(i < it->outputCount) out << QString::number(it->outputsGL[i], 'g', 17);
+			out << ";";
+			if(i < it->outputCount) out << QString::number(it->outputsWW[i], 'g', 17);
+		}
+		out << "\n";
+	}
+}
@@ -0,0 +1,227 @@
+#ifndef RLC_AUDIT_LOG_H
+#define RLC_AUDIT_LOG_H
+
+#include <QtCore/qglobal.h>
+#include <QtCore/qbytearray.h>
+#include <QtCore/qstring.h>
+#include <QtCore/qfile.h>
+#include <QtCore/qtextstream.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define AUDIT_MAX_OUTPUTS 8
+
+/** Origin of an audited calculation */
+enum class AuditSource : quint8 {
+	GUI = 0,
+	BATCH = 1,
+	WATCH = 2,
+	WORKSHEET = 3
+};
+
+/** One audited evaluation of one rule.
+The record has a fixed size so that it can be copied into the ring buffer
+without allocation and written to disk as is. Output values beyond
+AUDIT_MAX_OUTPUTS are not recorded, outputCount always holds the real count.
+*/
+struct AuditRecord {
+	quint64 timestamp;		///< milliseconds since epoch (UTC)
+	quint64 session;		///< identifies the process that wrote the record, see AuditLog::open()
+	quint64 sequence;		///< per session sequence number, gaps within a session mean dropped records
+	quint64 ruleSetHash;	///< FNV-1a hash of the rule index or of the single rule file, see RuleCatalog::getHash()
+	quint64 ruleNameHash;	///< FNV-1a hash of the rule name
+	double declared;
+	double density;
+	double outputsGL[AUDIT_MAX_OUTPUTS];
+	double outputsWW[AUDIT_MAX_OUTPUTS];
+	quint8 declaredUnit;	///< value of Unit
+	quint8 homogenous;
+	quint8 precision;
+	quint8 outputCount;
+	quint8 source;			///< value of AuditSource
+	quint8 reserved[3];
+};
+
+/** Bounded lock-free multi-producer/multi-consumer queue (D. Vyukov).
+Capacity is rounded up to a power of two. push() and pop() never block and
+never allocate.
+*/
+template<typename T>
+class LockFreeRingBuffer {
+public:
+	explicit LockFreeRingBuffer(size_t capacity) {
+		size_t size = 2;
+		while(size < capacity) size <<= 1;
+		this->mask = size - 1;
+		this->cells.reset(new Cell[size]);
+		for(size_t i = 0; i < size; ++i) {
+			this->cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+		this->head.store(0, std::memory_order_relaxed);
+		this->tail.store(0, std::memory_order_relaxed);
+	}
+
+	bool push(const T &value) {
+		Cell *cell;
+		size_t pos = this->tail.load(std::memory_order_relaxed);
+		for(;;) {
+			cell = &this->cells[pos & this->mask];
+			size_t seq = cell->sequence.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+			if(diff == 0) {
+				if(this->tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+			} else if(diff < 0) {
+				return false;
+			} else {
+				pos = this->tail.load(std::memory_order_relaxed);
+			}
+		}
+		cell->data = value;
+		cell->sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T &value) {
+		Cell *cell;
+		size_t pos = this->head.load(std::memory_order_relaxed);
+		for(;;) {
+			cell = &this->cells[pos & this->mask];
+			size_t seq = cell->sequence.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+			if(diff == 0) {
+				if(this->head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+			} else if(diff < 0) {
+				return false;
+			} else {
+				pos = this->head.load(std::memory_order_relaxed);
+			}
+		}
+		value = cell->data;
+		cell->sequence.store(pos + this->mask + 1, std::memory_order_release);
+		return true;
+	}
+
+	size_t capacity() const {return this->mask + 1;}
+	/** Approximate number of queued elements */
+	size_t size() const {
+		return this->tail.load(std::memory_order_relaxed) - this->head.load(std::memory_order_relaxed);
+	}
+private:
+	struct Cell {
+		std::atomic<size_t> sequence;
+		T data;
+	};
+
+	std::unique_ptr<Cell[]> cells;
+	size_t mask;
+	// keep producer and consumer index on separate cache lines
+	char padHead[64];
+	std::atomic<size_t> head;
+	char padTail[64];
+	std::atomic<size_t> tail;
+};
+
+/** Append-only, checksummed audit trail.
+Producers (GUI thread, batch workers) call record() which only copies the
+record into a lock-free ring buffer. A background thread drains the buffer
+in batches and appends them as CRC-32 protected blocks to the log file.
+If the buffer is full, batch, watch-folder and worksheet producers wait for
+the writer, so their records are never lost. Only GUI records are dropped
+(and counted) instead of stalling the window.
+Records that cannot be written (e.g. on a full disk) are counted as dropped
+as well; the log then reports the failure through hasFailed() until it is
+opened again.
+
+File layout: a 16 byte file header ("RLCAUDIT", format version, record size)
+followed by any number of blocks. Each block has a 24 byte header (magic,
+record count, number of records dropped before this block, CRC-32 over the
+dropped counter and the payload) followed by the raw records.
+*/
+class AuditLog {
+public:
+	static const quint32 FORMAT_VERSION = 2;
+	static const quint32 BLOCK_MAGIC = 0x4B4C4252; // "RBLK"
+
+	explicit AuditLog(size_t capacity = 4096);
+	~AuditLog(void);
+
+	/** Open (or create) the log file and start the writer thread.
+	Every call starts a new session, sequence numbers restart at 0.
+	*/
+	bool open(const QString &path);
+	void close();
+	/** Records are being written and none was lost to a write error since open() */
+	bool isOpen() const {return this->running.load(std::memory_order_relaxed) && !this->failed.load(std::memory_order_relaxed);}
+	/** A block could not be written since open(), see errorString() */
+	bool hasFailed() const {return this->failed.load(std::memory_order_relaxed);}
+	QString errorString() const;
+	/** Wait until all records queued so far are written (or lost)
+	\return false if a record was lost to a write error since open()
+	*/
+	bool flush();
+
+	/** Queue a record. Fills in timestamp, session and sequence.
+	Blocks while the buffer is full unless the record comes from the GUI.
+	*/
+	void record(AuditRecord &record);
+
+	void setRuleSetHash(quint64 hash) {this->ruleSetHash.store(hash, std::memory_order_relaxed);}
+	quint64 getRuleSetHash() const {return this->ruleSetHash.load(std::memory_order_relaxed);}
+
+	static quint64 hash(const QByteArray &data, quint64 seed = 14695981039346656037ULL);
+	static quint64 hash(const QString &string) {return hash(string.toUtf8());}
+	static quint32 crc32(const char *data, size_t length, quint32 crc = 0);
+private:
+	void writerLoop();
+	void flushPending();
+
+	LockFreeRingBuffer<AuditRecord> buffer;
+	quint64 session;
+	std::atomic<quint64> sequence;
+	std::atomic<quint64> dropped;
+	std::atomic<quint64> ruleSetHash;
+	std::atomic<bool> running;
+	std::atomic<bool> failed;
+	/** records written, dropped or lost, compared with sequence by flush() */
+	std::atomic<quint64> settled;
+	/** records lost to write errors since open(), only used by the writer */
+	quint64 lost;
+
+	std::thread writer;
+	std::mutex wakeMutex;
+	std::condition_variable wake;
+	std::mutex spaceMutex;
+	std::condition_variable space;
+	std::vector<AuditRecord> pending;
+	QFile file;
+	mutable std::mutex errorMutex;
+	QString error;
+};
+
+/** Reads an audit log and verifies the block checksums */
+class AuditLogReader {
+public:
+	AuditLogReader(void) : corruptBlocks(0), droppedRecords(0) {}
+
+	bool read(const QString &path);
+	/** Write all valid records as semicolon separated values */
+	void exportCsv(QTextStream &out) const;
+
+	const std::vector<AuditRecord>& getRecords() const {return this->records;}
+	unsigned int getCorruptBlocks() const {return this->corruptBlocks;}
+	quint64 getDroppedRecords() const {return this->droppedRecords;}
+	QString errorString() const {return this->error;}
+private:
+	std::vector<AuditRecord> records;
+	unsigned int corruptBlocks;
+	quint64 droppedRecords;
+	QString error;
+};
+
+#endif //RLC_AUDIT_LOG_H
@@ -0,0 +1,327 @@
+#include "BatchSample.h"
+
+#include <QtCore/qfile.h>
+#include <QtCore/qregexp.h>
+#include <QtCore/qtextstream.h>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+double parseDecimal(QString text, bool *ok) {
+	text.replace(',', '.');
+	return text.trimmed().toDouble(ok);
+}
+
+Unit parseUnit(const QString &text) {
+	QString unit = text.trimmed();
+	unit.remove(' ');
+	if(unit == "g/l") {
+		return Unit::g_per_l;
+	} else if(unit == "%w/w") {
+		return Unit::PERCENT_WW;
+	}
+	return Unit::INVALID;
+}
+
+BatchSample parseBatchLine(const QString &line) {
+	QStringList fields = line.split(QRegExp("[;\\t]"));
+	BatchSample sample;
+	bool ok;
+
+	if(fields.isEmpty() || fields.at(0).trimmed().isEmpty()) {
+		throw std::runtime_error("The declared value must not be left blank.");
+	}
+	double declared = parseDecimal(fields.at(0), &ok);
+	if(!ok) {
+		throw std::runtime_error("The declared value has to be a number.");
+	}
+
+	Unit unit = Unit::g_per_l;
+	if(fields.size() > 1 && !fields.at(1).trimmed().isEmpty()) {
+		unit = parseUnit(fields.at(1));
+		if(unit == Unit::INVALID) {
+			throw std::runtime_error("The unit must be \"g/l\" or \"%w/w\".");
+		}
+	}
+	sample.declared = ratio(declared, unit);
+
+	if(fields.size() > 2 && !fields.at(2).trimmed().isEmpty()) {
+		sample.density = parseDecimal(fields.at(2), &ok);
+		if(!ok || !isValidDensity(sample.density)) {
+			throw std::runtime_error("The density must be a positive value of at least 0.000001.");
+		}
+		sample.densityGiven = true;
+	}
+
+	if(fields.size() > 3 && !fields.at(3).trimmed().isEmpty()) {
+		QString homogeneity = fields.at(3).trimmed().toLower();
+		if(homogeneity == "homogenous") {
+			sample.homogenous = true;
+		} else if(homogeneity == "heterogenous") {
+			sample.homogenous = false;
+		} else {
+			throw std::runtime_error("The homogeneity must be \"homogenous\" or \"heterogenous\".");
+		}
+	}
+
+	if(fields.size() > 4) {
+		sample.product = fields.at(4).trimmed();
+	}
+
+	if(fields.size() > 5 && !fields.at(5).trimmed().isEmpty()) {
+		sample.temperature = parseDecimal(fields.at(5), &ok);
+		if(!ok) {
+			throw std::runtime_error("The temperature has to be a number.");
+		}
+	}
+
+	return sample;
+}
+
+std::vector<size_t> resolveDensities(std::vector<BatchSample> &samples, const DensityTable *densities) {
+	std::vector<size_t> failed;
+	QHash<QString, std::vector<size_t>> byProduct;
+	for(size_t i = 0; i < samples.size(); ++i) {
+		if(!samples[i].densityGiven && !samples[i].product.isEmpty()) {
+			byProduct[samples[i].product].push_back(i);
+		}
+	}
+
+	std::vector<double> temperatures, results;
+	for(auto it = byProduct.begin(); it != byProduct.end(); ++it) {
+		const std::vector<size_t> &indices = it.value();
+		int product = densities != nullptr ? densities->productIndex(it.key()) : -1;
+		if(product < 0) {
+			failed.insert(failed.end(), indices.begin(), indices.end());
+			continue;
+		}
+
+		temperatures.resize(indices.size());
+		results.resize(indices.size());
+		for(size_t i = 0; i < indices.size(); ++i) {
+			temperatures[i] = samples[indices[i]].temperature;
+		}
+		densities->lookup(product, temperatures.data(), indices.size(), results.data());
+		for(size_t i = 0; i < indices.size(); ++i) {
+			if(isValidDensity(results[i])) {
+				samples[indices[i]].density = results[i];
+			} else {
+				failed.push_back(indices[i]);
+			}
+		}
+	}
+	std::sort(failed.begin(), failed.end());
+	return failed;
+}
+
+std::vector<BatchSample> readBatchFile(const QString &path, const DensityTable *densities) {
+	QFile file(path);
+	if(!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+		throw std::runtime_error(QString("The batch file %1 could not be opened.").arg(path).toStdString());
+	}
+
+	std::vector<BatchSample> samples;
+	std::vector<int> lineNumbers;
+	QTextStream in(&file);
+	int lineNumber = 0;
+	while(!in.atEnd()) {
+		QString line = in.readLine();
+		++lineNumber;
+		if(line.trimmed().isEmpty() || line.trimmed().startsWith('#')) {
+			continue;
+		}
+		try {
+			samples.push_back(parseBatchLine(line));
+			lineNumbers.push_back(lineNumber);
+		} catch(std::runtime_error &e) {
+			throw std::runtime_error(QString("%1, line %2: %3").arg(path).arg(lineNumber).arg(e.what()).toStdString());
+		}
+	}
+
+	std::vector<size_t> failed = resolveDensities(samples, densities);
+	if(!failed.empty()) {
+		const BatchSample &sample = samples[failed.front()];
+		throw std::runtime_error(QString("%1, line %2: No density of \"%3\" at %4%5C in the density table.")
+			.arg(path).arg(lineNumbers[failed.front()]).arg(sample.product).arg(sample.temperature).arg(QChar(0xB0)).toStdString());
+	}
+	return samples;
+}
+
+void noteAssumedDensity(QTextStream &out, int sampleNumber, const BatchSample &sample) {
+	if(sample.densityAssumed()) {
+		out << "# sample " << sampleNumber << ": no density or product given, a density of "
+			<< QString::number(sample.density, 'f', 2) << " is assumed\n";
+	}
+}
+
+void auditEvaluation(AuditLog *auditLog, quint64 ruleNameHash, ratio declared, double density, bool homogenous,
+					 const ratio *values, size_t count, unsigned int precision, AuditSource source, bool exact) {
+	AuditRecord record;
+	record.ruleNameHash = ruleNameHash;
+	record.declared = declared.getValue();
+	record.declaredUnit = static_cast<quint8>(declared.getUnit());
+	record.density = density;
+	record.homogenous = homogenous ? 1 : 0;
+	record.precision = static_cast<quint8>(precision);
+	record.outputCount = static_cast<quint8>(count);
+	record.source = static_cast<quint8>(source);
+	const qint64 fixedDensity = exact ? toFixed(density) : 0;
+	for(size_t i = 0; i < AUDIT_MAX_OUTPUTS; ++i) {
+		if(i >= count) {
+			record.outputsGL[i] = record.outputsWW[i] = 0.;
+		} else if(exact) {
+			// the values the user sees, converted in fixed-point
+			qint64 value = toFixed(values[i].getValue());
+			record.outputsGL[i] = fromFixed(fixedConvert(value, values[i].getUnit(), Unit::g_per_l, fixedDensity));
+			record.outputsWW[i] = fromFixed(fixedConvert(value, values[i].getUnit(), Unit::PERCENT_WW, fixedDensity));
+		} else {
+			record.outputsGL[i] = values[i].g_l(density);
+			record.outputsWW[i] = values[i].w_w(density);
+		}
+	}
+	record.reserved[0] = record.reserved[1] = record.reserved[2] = 0;
+	auditLog->record(record);
+}
+
+BatchEvaluator::BatchEvaluator(const std::vector<ReleaseLimitsRule*> &rules, unsigned int precision,
+							   AuditLog *auditLog, AuditSource source, bool exact, const DensityTable *densities)
+	: precision(precision), auditLog(auditLog), source(source), exact(exact), densities(densities) {
+	for(auto it = rules.begin(); it != rules.end(); ++it) {
+		if(!(*it)->getRuleSet()) {
+			throw std::logic_error(QString("The rule %1 has not been compiled.").arg((*it)->getName()).toStdString());
+		}
+		CompiledRule rule = {(*it)->getRuleSet(), (*it)->getRuleSetIndex(), (*it)->getName(), (*it)->getOutputTitles()};
+		this->rules.push_back(rule);
+	}
+	this->init();
+}
+
+BatchEvaluator::BatchEvaluator(const std::vector<CompiledRule> &rules, unsigned int precision,
+							   AuditLog *auditLog, AuditSource source, bool exact, const DensityTable *densities)
+	: rules(rules), precision(precision), auditLog(auditLog), source(source), exact(exact), densities(densities) {
+	this->init();
+}
+
+void BatchEvaluator::init() {
+	this->offsets.push_back(0);
+	for(auto it = this->rules.begin(); it != this->rules.end(); ++it) {
+		this->nameHashes.push_back(AuditLog::hash(it->name));
+		auto generation = std::find(this->generations.begin(), this->generations.end(), it->ruleSet.get());
+		this->generationOf.push_back(generation - this->generations.begin());
+		if(generation == this->generations.end()) {
+			this->generations.push_back(it->ruleSet.get());
+		}
+		this->offsets.push_back(this->offsets.back() + it->ruleSet->outputCount(it->index));
+	}
+}
+
+bool isFixedRange(const ratio &declared, double density) {
+	if(!isValidDensity(density) || !(density <= FIXED_MAX_DENSITY)) {
+		return false;
+	}
+	const double gl = declared.g_l(density);
+	const double ww = declared.w_w(density);
+	return std::fabs(gl) <= FIXED_MAX_VALUE && std::fabs(ww) <= FIXED_MAX_VALUE;
+}
+
+QString BatchEvaluator::checkSample(const BatchSample &sample) const {
+	if(!this->exact || isFixedRange(sample.declared, sample.density)) {
+		return QString();
+	}
+	return QString("The exact calculation supports declared values up to %1 g/l and %1 %w/w and densities up to %2 g/ml.")
+		.arg(FIXED_MAX_VALUE, 0, 'f', 0).arg(FIXED_MAX_DENSITY, 0, 'f', 0);
+}
+
+BatchEvaluator::Result BatchEvaluator::evaluate(const BatchSample &sample) const {
+	Result result;
+	this->evaluate(&sample, 1, &result);
+	return result;
+}
+
+void BatchEvaluator::evaluate(const BatchSample *samples, size_t count, Result *results) const {
+	for(size_t s = 0; s < count; ++s) {
+		results[s].assign(this->offsets.back(), ratio(0., Unit::g_per_l));
+	}
+	if(this->exact) {
+		this->evaluateExact(samples, count, results);
+	} else {
+		// one buffer per generation, evaluateAll() fills all of its rules at once
+		std::vector<std::vector<double>> outputs(this->generations.size());
+		for(size_t g = 0; g < this->generations.size(); ++g) {
+			outputs[g].resize(this->generations[g]->totalOutputs());
+		}
+		for(size_t s = 0; s < count; ++s) {
+			const BatchSample &sample = samples[s];
+			for(size_t g = 0; g < this->generations.size(); ++g) {
+				this->generations[g]->evaluateAll(sample.declared, sample.density, sample.homogenous, outputs[g].data());
+			}
+			for(size_t r = 0; r < this->rules.size(); ++r) {
+				const CompiledRule &rule = this->rules[r];
+				const Unit unit = rule.ruleSet->getUnit(rule.index);
+				const double *values = outputs[this->generationOf[r]].data() + rule.ruleSet->outputOffset(rule.index);
+				for(size_t i = 0; i < this->outputCount(r); ++i) {
+					results[s][this->offsets[r] + i] = ratio(values[i], unit);
+				}
+			}
+		}
+	}
+
+	if(this->auditLog != nullptr) {
+		for(size_t s = 0; s < count; ++s) {
+			const BatchSample &sample = samples[s];
+			for(size_t r = 0; r < this->rules.size(); ++r) {
+				auditEvaluation(this->auditLog, this->nameHashes[r], sample.declared, sample.density, sample.homogenous,
+					results[s].data() + this->offsets[r], this->outputCount(r), this->precision, this->source, this->exact);
+			}
+		}
+	}
+}
+
+void BatchEvaluator::evaluateExact(const BatchSample *samples, size_t count, Result *results) const {
+	// declared values in micro units of both units, converted once per sample
+	std::vector<qint64> declaredGL(count), declaredWW(count);
+	std::vector<quint8> homogenous(count);
+	for(size_t s = 0; s < count; ++s) {
+		const qint64 density = toFixed(samples[s].density);
+		const qint64 declared = toFixed(samples[s].declared.getValue());
+		declaredGL[s] = fixedConvert(declared, samples[s].declared.getUnit(), Unit::g_per_l, density);
+		declaredWW[s] = fixedConvert(declared, samples[s].declared.getUnit(), Unit::PERCENT_WW, density);
+		homogenous[s] = samples[s].homogenous ? 1 : 0;
+	}
+
+	std::vector<qint64> outputs;
+	for(size_t r = 0; r < this->rules.size(); ++r) {
+		const CompiledRule &rule = this->rules[r];
+		const FixedPointRule exactRule = rule.ruleSet->exact(rule.index);
+		const Unit unit = exactRule.getUnit();
+		const size_t outputCount = exactRule.outputCount();
+		outputs.resize(count * outputCount);
+		exactRule.evaluateBatch(unit == Unit::g_per_l ? declaredGL.data() : declaredWW.data(), homogenous.data(), count, outputs.data());
+		// toFixed(fromFixed(q)) == q, formatting and auditing get the micro units back without loss
+		for(size_t s = 0; s < count; ++s) {
+			for(size_t i = 0; i < outputCount; ++i) {
+				results[s][this->offsets[r] + i] = ratio(fromFixed(outputs[s * outputCount + i]), unit);
+			}
+		}
+	}
+}
+
+void BatchEvaluator::format(QTextStream &out, int sampleNumber, const BatchSample &sample, const Result &result) const {
+	noteAssumedDensity(out, sampleNumber, sample);
+	for(size_t r = 0; r < this->rules.size() && this->offsets[r + 1] <= result.size(); ++r) {
+		const QStringList &titles = this->rules[r].titles;
+		const ratio *values = result.data() + this->offsets[r];
+		for(size_t i = 0; i < this->outputCount(r) && i < (size_t)titles.size(); ++i) {
+			out << sampleNumber << ";" << this->rules[r].name << ";" << titles.at(i) << ";"
+				<< this->formatValue(values[i], Unit::g_per_l, sample.density) << ";"
+				<< this->formatValue(values[i], Unit::PERCENT_WW, sample.density) << "\n";
+		}
+	}
+}
+QString BatchEvaluator::formatValue(const ratio &value, Unit unit, double density) const {
+	if(this->exact) {
+		// convert and round in fixed-point as well, the text is then identical on every build
+		return fixedToString(fixedConvert(toFixed(value.getValue()), value.getUnit(), unit, toFixed(density)), this->precision);
+	}
+	return QString::number(value.as(unit, density), 'f', this->precision);
+}
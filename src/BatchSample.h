@@ -0,0 +1,143 @@
+#ifndef RLC_BATCH_SAMPLE_H
+#define RLC_BATCH_SAMPLE_H
+
+#include <QtCore/qstring.h>
+#include <QtCore/qstringlist.h>
+#include <vector>
+
+#include "ReleaseLimitsRule.h"
+#include "CompiledRuleSet.h"
+#include "AuditLog.h"
+#include "DensityTable.h"
+
+class QTextStream;
+
+/** One sample of a batch run */
+struct BatchSample {
+	BatchSample(void) : declared(0., Unit::g_per_l), density(1.), homogenous(true), densityGiven(false),
+		temperature(DensityTable::REFERENCE_TEMPERATURE) {}
+
+	ratio declared;
+	double density;
+	bool homogenous;
+	/** false if density holds the default, it is then taken from the density table if a product is given */
+	bool densityGiven;
+	QString product;
+	double temperature;
+
+	/** Neither a density nor a product was given, the default density is used */
+	bool densityAssumed() const {return !this->densityGiven && this->product.isEmpty();}
+};
+
+/** Parse a number, point and comma may be used as decimal separator */
+double parseDecimal(QString text, bool *ok);
+
+/** Densities have to be representable in micro units, else the fixed-point engine cannot convert */
+inline bool isValidDensity(double density) {
+	return density >= 1. / FIXED_ONE;
+}
+
+/** The fixed-point engine can evaluate the declared value with the given density without overflow:
+the value is at most FIXED_MAX_VALUE in both units and the density at most FIXED_MAX_DENSITY
+*/
+bool isFixedRange(const ratio &declared, double density);
+
+/** Parse a unit string ("g/l", "%w/w" or "% w/w")
+\return Unit::INVALID if the string is not a known unit
+*/
+Unit parseUnit(const QString &text);
+
+/** Parse one line of a batch file.
+Format: declared;unit;density;homogeneity;product;temperature
+Fields may also be separated by tabs. All fields but the declared value are
+optional, unit, density and homogeneity default to g/l, 1.00 and homogenous.
+If no density but a product is given, the density is looked up later by
+resolveDensities() at the given temperature (default 20 degrees Celsius).
+\throws std::runtime_error if the line is malformed
+*/
+BatchSample parseBatchLine(const QString &line);
+
+/** Take the density of every sample without an explicit density but with a product from the table.
+Samples of the same product are looked up together.
+\return the indices of samples whose product or temperature is not in the table
+*/
+std::vector<size_t> resolveDensities(std::vector<BatchSample> &samples, const DensityTable *densities);
+
+/** Read all samples of a batch file. Empty lines and lines starting with # are skipped.
+\throws std::runtime_error naming the offending line
+*/
+std::vector<BatchSample> readBatchFile(const QString &path, const DensityTable *densities = nullptr);
+
+/** Write a comment line to batch output if the sample is calculated with the default density */
+void noteAssumedDensity(QTextStream &out, int sampleNumber, const BatchSample &sample);
+
+/** Record one rule evaluation in the audit log
+\param exact the values come from the fixed-point engine, convert them to both units in fixed-point as well
+*/
+void auditEvaluation(AuditLog *auditLog, quint64 ruleNameHash, ratio declared, double density, bool homogenous,
+	const ratio *values, size_t count, unsigned int precision, AuditSource source, bool exact = false);
+
+/** Evaluates samples against a fixed selection of rules.
+Holds a snapshot of everything it needs (including a reference to the
+compiled rule sets), evaluate() and format() may be called from worker threads.
+Samples are evaluated with CompiledRuleSet::evaluateAll() once per rule set
+generation into a buffer that is reused for all samples of a call.
+*/
+class BatchEvaluator {
+public:
+	/** Values of all selected rules for one sample, rule after rule, see outputOffset() */
+	typedef std::vector<ratio> Result;
+
+	/**
+	\param exact use the fixed-point engine, results are then bit-reproducible across builds
+	\throws std::logic_error if a rule is not compiled
+	*/
+	BatchEvaluator(const std::vector<ReleaseLimitsRule*> &rules, unsigned int precision,
+		AuditLog *auditLog, AuditSource source, bool exact = false, const DensityTable *densities = nullptr);
+	BatchEvaluator(const std::vector<CompiledRule> &rules, unsigned int precision,
+		AuditLog *auditLog, AuditSource source, bool exact = false, const DensityTable *densities = nullptr);
+
+	Result evaluate(const BatchSample &sample) const;
+	/** Evaluate count samples at once, results receives count results */
+	void evaluate(const BatchSample *samples, size_t count, Result *results) const;
+	/** Why the sample cannot be evaluated, empty if it can. Only the fixed-point engine has limits,
+	samples with a density from the table have to be checked after resolveDensities().
+	*/
+	QString checkSample(const BatchSample &sample) const;
+	/** Write one line per rule output: sample;rule;output;g/l;% w/w
+	preceded by a comment if the sample uses the default density, see noteAssumedDensity()
+	*/
+	void format(QTextStream &out, int sampleNumber, const BatchSample &sample, const Result &result) const;
+
+	/** Format one output value in the given unit at the evaluator's precision */
+	QString formatValue(const ratio &value, Unit unit, double density) const;
+
+	static const char* header() {return "sample;rule;output;g/l;% w/w\n";}
+	const DensityTable* getDensityTable() const {return this->densities;}
+	size_t ruleCount() const {return this->rules.size();}
+	const QString& getRuleName(size_t rule) const {return this->rules[rule].name;}
+	const QStringList& getOutputTitles(size_t rule) const {return this->rules[rule].titles;}
+	/** Index of the first value of a rule in a Result */
+	size_t outputOffset(size_t rule) const {return this->offsets[rule];}
+	size_t outputCount(size_t rule) const {return this->offsets[rule + 1] - this->offsets[rule];}
+private:
+	void init();
+	/** Evaluate with FixedPointRule::evaluateBatch(), one call per rule for all samples */
+	void evaluateExact(const BatchSample *samples, size_t count, Result *results) const;
+
+	std::vector<CompiledRule> rules;
+	std::vector<quint64> nameHashes;
+	/** distinct rule set generations of the rules */
+	std::vector<const CompiledRuleSet*> generations;
+	/** per rule: index into generations */
+	std::vector<size_t> generationOf;
+	/** per rule and one past the last rule: offset in a Result */
+	std::vector<size_t> offsets;
+	unsigned int precision;
+	AuditLog *auditLog;
+	AuditSource source;
+	bool exact;
+	const DensityTable *densities;
+};
+
+#endif //RLC_BATCH_SAMPLE_H
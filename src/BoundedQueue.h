@@ -0,0 +1,71 @@
+#ifndef RLC_BOUNDED_QUEUE_H
+#define RLC_BOUNDED_QUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/** Blocking queue with a fixed capacity connecting two pipeline stages.
+push() blocks while the queue is full, which throttles the producing stage
+(backpressure). After close() no more elements are accepted, pop() returns
+the remaining elements and then false.
+*/
+template<typename T>
+class BoundedQueue {
+public:
+	explicit BoundedQueue(size_t capacity) : capacity(capacity), closed(false) {}
+
+	/** \return false if the queue was closed */
+	bool push(T &&value) {
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->notFull.wait(lock, [this]() {return this->closed || this->queue.size() < this->capacity;});
+		if(this->closed) {
+			return false;
+		}
+		this->queue.push_back(std::move(value));
+		this->notEmpty.notify_one();
+		return true;
+	}
+
+	/** Like push() but never blocks
+	\return false if the queue is full or closed
+	*/
+	bool tryPush(T &&value) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		if(this->closed || this->queue.size() >= this->capacity) {
+			return false;
+		}
+		this->queue.push_back(std::move(value));
+		this->notEmpty.notify_one();
+		return true;
+	}
+
+	/** \return false if the queue is closed and empty */
+	bool pop(T &value) {
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->notEmpty.wait(lock, [this]() {return this->closed || !this->queue.empty();});
+		if(this->queue.empty()) {
+			return false;
+		}
+		value = std::move(this->queue.front());
+		this->queue.pop_front();
+		this->notFull.notify_one();
+		return true;
+	}
+
+	void close() {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->closed = true;
+		this->notEmpty.notify_all();
+		this->notFull.notify_all();
+	}
+private:
+	const size_t capacity;
+	bool closed;
+	std::deque<T> queue;
+	std::mutex mutex;
+	std::condition_variable notEmpty;
+	std::condition_variable notFull;
+};
+
+#endif //RLC_BOUNDED_QUEUE_H
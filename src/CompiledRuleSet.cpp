@@ -0,0 +1,154 @@
+#include "CompiledRuleSet.h"
+
+/** Hand out consecutive, suitably aligned pieces of the arena */
+class ArenaCursor {
+public:
+	ArenaCursor(char *base) : base(base), offset(0) {}
+
+	template<typename T>
+	T* take(size_t count) {
+		this->offset = (this->offset + alignof(T) - 1) / alignof(T) * alignof(T);
+		T *p = this->base != nullptr ? reinterpret_cast<T*>(this->base + this->offset) : nullptr;
+		this->offset += count * sizeof(T);
+		return p;
+	}
+	size_t size() const {return this->offset;}
+private:
+	char *base;
+	size_t offset;
+};
+
+CompiledRuleSet::CompiledRuleSet(const std::vector<RuleSpec> &specs)
+	: arenaSize(0), ruleCount(specs.size()), limitCount(0), offsetCount(0) {
+	for(auto it = specs.begin(); it != specs.end(); ++it) {
+		this->limitCount += it->limits.size();
+		this->offsetCount += it->outputs.size();
+	}
+
+	// first pass measures, second pass assigns the pointers
+	for(int pass = 0; pass < 2; ++pass) {
+		ArenaCursor cursor(pass == 0 ? nullptr : reinterpret_cast<char*>(this->arena.get()));
+		this->thresholds = cursor.take<double>(this->limitCount);
+		this->factorLow = cursor.take<double>(this->limitCount);
+		this->factorHigh = cursor.take<double>(this->limitCount);
+		this->absoluteLow = cursor.take<double>(this->limitCount);
+		this->absoluteHigh = cursor.take<double>(this->limitCount);
+		this->offsets = cursor.take<double>(this->offsetCount);
+		this->fixedThresholds = cursor.take<qint64>(this->limitCount);
+		this->fixedFactorLow = cursor.take<qint64>(this->limitCount);
+		this->fixedFactorHigh = cursor.take<qint64>(this->limitCount);
+		this->fixedAbsoluteLow = cursor.take<qint64>(this->limitCount);
+		this->fixedAbsoluteHigh = cursor.take<qint64>(this->limitCount);
+		this->fixedOffsets = cursor.take<qint64>(this->offsetCount);
+		this->rules = cursor.take<RuleHeader>(this->ruleCount);
+		this->flags = cursor.take<quint8>(this->limitCount);
+		if(pass == 0) {
+			this->arenaSize = cursor.size();
+			this->arena.reset(new qint64[(this->arenaSize + sizeof(qint64) - 1) / sizeof(qint64) + 1]);
+		}
+	}
+
+	size_t l = 0, o = 0;
+	for(size_t r = 0; r < specs.size(); ++r) {
+		const RuleSpec &spec = specs[r];
+		RuleHeader &header = this->rules[r];
+		header.firstLimit = static_cast<quint32>(l);
+		header.limitCount = static_cast<quint32>(spec.limits.size());
+		header.firstOutput = static_cast<quint32>(o);
+		header.outputCount = static_cast<quint32>(spec.outputs.size());
+		header.unit = spec.unit;
+
+		for(auto it = spec.outputs.begin(); it != spec.outputs.end(); ++it, ++o) {
+			this->offsets[o] = *it;
+			this->fixedOffsets[o] = toFixed(*it);
+		}
+		for(auto it = spec.limits.begin(); it != spec.limits.end(); ++it, ++l) {
+			this->thresholds[l] = it->threshold;
+			this->factorLow[l] = it->factor[0];
+			this->factorHigh[l] = it->factor[1];
+			this->absoluteLow[l] = it->absolute[0];
+			this->absoluteHigh[l] = it->absolute[1];
+			this->fixedThresholds[l] = toFixed(it->threshold);
+			this->fixedFactorLow[l] = toFixed(it->factor[0]);
+			this->fixedFactorHigh[l] = toFixed(it->factor[1]);
+			this->fixedAbsoluteLow[l] = toFixed(it->absolute[0]);
+			this->fixedAbsoluteHigh[l] = toFixed(it->absolute[1]);
+			this->flags[l] = (it->catch_all ? LIMIT_CATCH_ALL : 0)
+				| (it->thresh_inclusive ? LIMIT_INCLUSIVE : 0)
+				| (it->homogenous == Homogeneity::HOMOGENOUS ? LIMIT_HOMOGENOUS_ONLY : 0)
+				| (it->homogenous == Homogeneity::HETEROGENOUS ? LIMIT_HETEROGENOUS_ONLY : 0);
+		}
+	}
+}
+
+int CompiledRuleSet::findLimit(const RuleHeader &rule, double declared, bool homogenous) const {
+	const quint8 excluded = homogenous ? LIMIT_HETEROGENOUS_ONLY : LIMIT_HOMOGENOUS_ONLY;
+	const size_t end = rule.firstLimit + rule.limitCount;
+	for(size_t l = rule.firstLimit; l < end; ++l) {
+		const quint8 f = this->flags[l];
+		if((f & LIMIT_CATCH_ALL)
+			|| ((declared < this->thresholds[l] || (declared == this->thresholds[l] && (f & LIMIT_INCLUSIVE)))
+				&& !(f & excluded))) {
+			return static_cast<int>(l);
+		}
+	}
+	return -1;
+}
+
+std::vector<ratio> CompiledRuleSet::evaluate(size_t rule, ratio declared, double density, bool homogenous) const {
+	const RuleHeader &header = this->rules[rule];
+	std::vector<ratio> values(header.outputCount, declared);
+
+	const double value = declared.as(header.unit, density);
+	const int l = this->findLimit(header, value, homogenous);
+	if(l < 0) {
+		return values;
+	}
+	// same operations in the same order as the tolerance function, results are bit identical
+	const double toleranceLow = this->absoluteLow[l] + value * this->factorLow[l];
+	const double toleranceHigh = this->absoluteHigh[l] + value * this->factorHigh[l];
+	const double *offsets = this->offsets + header.firstOutput;
+	for(size_t i = 0; i < header.outputCount; ++i) {
+		values[i] = ratio(value + (offsets[i] < 0 ? toleranceLow : toleranceHigh) * offsets[i], header.unit);
+	}
+	return values;
+}
+
+void CompiledRuleSet::evaluateAll(ratio declared, double density, bool homogenous, double *outputs) const {
+	const double valueGL = declared.g_l(density);
+	const double valueWW = declared.w_w(density);
+	for(size_t r = 0; r < this->ruleCount; ++r) {
+		const RuleHeader &header = this->rules[r];
+		const double value = header.unit == Unit::g_per_l ? valueGL : valueWW;
+		double *out = outputs + header.firstOutput;
+		const int l = this->findLimit(header, value, homogenous);
+		if(l < 0) {
+			for(size_t i = 0; i < header.outputCount; ++i) {
+				out[i] = value;
+			}
+			continue;
+		}
+		const double toleranceLow = this->absoluteLow[l] + value * this->factorLow[l];
+		const double toleranceHigh = this->absoluteHigh[l] + value * this->factorHigh[l];
+		const double *offsets = this->offsets + header.firstOutput;
+		for(size_t i = 0; i < header.outputCount; ++i) {
+			out[i] = value + (offsets[i] < 0 ? toleranceLow : toleranceHigh) * offsets[i];
+		}
+	}
+}
+
+FixedPointRule CompiledRuleSet::exact(size_t rule) const {
+	const RuleHeader &header = this->rules[rule];
+	FixedPointRule view;
+	view.unit = header.unit;
+	view.offsetCount = header.outputCount;
+	view.limitCount = header.limitCount;
+	view.offsets = this->fixedOffsets + header.firstOutput;
+	view.flags = this->flags + header.firstLimit;
+	view.thresholds = this->fixedThresholds + header.firstLimit;
+	view.factorLow = this->fixedFactorLow + header.firstLimit;
+	view.factorHigh = this->fixedFactorHigh + header.firstLimit;
+	view.absoluteLow = this->fixedAbsoluteLow + header.firstLimit;
+	view.absoluteHigh = this->fixedAbsoluteHigh + header.firstLimit;
+	return view;
+}
@@ -0,0 +1,93 @@
+#ifndef RLC_COMPILED_RULE_SET_H
+#define RLC_COMPILED_RULE_SET_H
+
+#include <QtCore/qstring.h>
+#include <QtCore/qstringlist.h>
+#include <memory>
+#include <vector>
+
+#include "ReleaseLimitsRule.h"
+#include "FixedPoint.h"
+
+/** All rules of one rule-set generation in structure-of-arrays form.
+Every array lives in a single arena allocated in the constructor, the limits
+of a rule are stored next to each other and the limits of all rules follow
+each other. Evaluating all rules for one sample therefore walks a few
+contiguous arrays instead of scattered heap objects, and dropping the last
+reference to a generation frees all of its rules at once.
+
+Double and fixed-point (micro unit) copies of the numbers are kept side by
+side so both engines work on the same layout.
+*/
+class CompiledRuleSet {
+public:
+	explicit CompiledRuleSet(const std::vector<RuleSpec> &specs);
+	~CompiledRuleSet(void) {}
+
+	size_t size() const {return this->ruleCount;}
+	Unit getUnit(size_t rule) const {return this->rules[rule].unit;}
+	size_t outputCount(size_t rule) const {return this->rules[rule].outputCount;}
+	/** Index of the first value of the rule in the output of evaluateAll() */
+	size_t outputOffset(size_t rule) const {return this->rules[rule].firstOutput;}
+	size_t totalOutputs() const {return this->offsetCount;}
+	/** Bytes held by the arena */
+	size_t memoryUsage() const {return this->arenaSize;}
+
+	/** Same results as the tolerance function built from the rule's RuleSpec */
+	std::vector<ratio> evaluate(size_t rule, ratio declared, double density, bool homogenous) const;
+	/** Evaluate every rule of the set for one sample.
+	\param outputs receives totalOutputs() values, each in the unit of its rule
+	*/
+	void evaluateAll(ratio declared, double density, bool homogenous, double *outputs) const;
+
+	FixedPointRule exact(size_t rule) const;
+private:
+	friend class InverseSolver;
+
+	struct RuleHeader {
+		quint32 firstLimit;
+		quint32 limitCount;
+		quint32 firstOutput;
+		quint32 outputCount;
+		Unit unit;
+	};
+
+	/** First matching limit of a rule or -1, declared in the rule's unit */
+	int findLimit(const RuleHeader &rule, double declared, bool homogenous) const;
+
+	std::unique_ptr<qint64[]> arena;
+	size_t arenaSize;
+	size_t ruleCount;
+	size_t limitCount;
+	size_t offsetCount;
+
+	// double precision
+	double *thresholds;
+	double *factorLow;
+	double *factorHigh;
+	double *absoluteLow;
+	double *absoluteHigh;
+	double *offsets;
+	// micro units
+	qint64 *fixedThresholds;
+	qint64 *fixedFactorLow;
+	qint64 *fixedFactorHigh;
+	qint64 *fixedAbsoluteLow;
+	qint64 *fixedAbsoluteHigh;
+	qint64 *fixedOffsets;
+
+	RuleHeader *rules;
+	quint8 *flags;
+};
+
+/** One rule of a rule set generation with the names needed to report its values.
+Unlike ReleaseLimitsRule it has no widgets, so it can be used without a GUI.
+*/
+struct CompiledRule {
+	std::shared_ptr<const CompiledRuleSet> ruleSet;
+	size_t index;
+	QString name;
+	QStringList titles;
+};
+
+#endif //RLC_COMPILED_RULE_SET_H
@@ -0,0 +1,118 @@
+#include "DensityTable.h"
+
+#include <QtCore/qfile.h>
+#include <QtCore/qjsonarray.h>
+#include <QtCore/qjsondocument.h>
+#include <QtCore/qjsonobject.h>
+#include <algorithm>
+#include <utility>
+
+constexpr double DensityTable::REFERENCE_TEMPERATURE;
+
+bool DensityTable::load(const QString &path, QStringList &warnings) {
+	QFile file(path);
+	if(!file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+	QJsonParseError jerr;
+	QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &jerr);
+	file.close();
+	if(jerr.error != QJsonParseError::NoError || !doc.isArray()) {
+		warnings.append(QString("The density table %1 could not be parsed.\n%2").arg(path).arg(jerr.errorString()));
+		return false;
+	}
+
+	QJsonArray arr = doc.array();
+	for(auto it = arr.begin(); it != arr.end(); ++it) {
+		QJsonObject obj = (*it).toObject();
+		if(!obj["product"].isString() || !obj["densities"].isArray()) {
+			warnings.append(QString("Skipping product #%1.\nKey \"product\" or \"densities\" is missing.").arg(it - arr.begin()));
+			continue;
+		}
+		QString name = obj["product"].toString();
+
+		std::vector<std::pair<double, double>> points;
+		QJsonArray jpoints = obj["densities"].toArray();
+		bool valid = !jpoints.isEmpty();
+		for(auto p = jpoints.begin(); p != jpoints.end() && valid; ++p) {
+			QJsonObject point = (*p).toObject();
+			valid = point["temperature"].isDouble() && point["density"].isDouble() && point["density"].toDouble() > 0;
+			points.push_back(std::make_pair(point["temperature"].toDouble(), point["density"].toDouble()));
+		}
+		std::sort(points.begin(), points.end());
+		for(size_t i = 1; i < points.size() && valid; ++i) {
+			valid = points[i].first > points[i - 1].first;
+		}
+		if(!valid || this->index.contains(name)) {
+			warnings.append(QString("Skipping product \"%1\".\nEvery entry needs a unique temperature and a positive density.").arg(name));
+			continue;
+		}
+
+		Product product;
+		product.name = name;
+		product.first = this->temperatures.size();
+		product.count = points.size();
+		for(size_t i = 0; i < points.size(); ++i) {
+			this->temperatures.push_back(points[i].first);
+			if(i + 1 < points.size()) {
+				double slope = (points[i + 1].second - points[i].second) / (points[i + 1].first - points[i].first);
+				this->slopes.push_back(slope);
+				this->intercepts.push_back(points[i].second - slope * points[i].first);
+			} else {
+				// last point: constant, only reached at exactly this temperature
+				this->slopes.push_back(0.);
+				this->intercepts.push_back(points[i].second);
+			}
+		}
+		this->index.insert(name, static_cast<int>(this->productList.size()));
+		this->productList.push_back(product);
+	}
+	return true;
+}
+
+QStringList DensityTable::products() const {
+	QStringList names;
+	for(auto it = this->productList.begin(); it != this->productList.end(); ++it) {
+		names.append(it->name);
+	}
+	return names;
+}
+
+double DensityTable::lookup(int product, double temperature) const {
+	double density;
+	this->lookup(product, &temperature, 1, &density);
+	return density;
+}
+
+void DensityTable::lookup(int product, const double *temperatures, size_t count, double *densities) const {
+	if(product < 0 || product >= static_cast<int>(this->productList.size())) {
+		std::fill(densities, densities + count, 0.);
+		return;
+	}
+	const Product &p = this->productList[product];
+	const double *t = this->temperatures.data() + p.first;
+	const double *a = this->intercepts.data() + p.first;
+	const double *b = this->slopes.data() + p.first;
+	const double low = t[0];
+	const double high = t[p.count - 1];
+
+	// segment search by counting the inner points below each temperature, branch-free
+	std::vector<size_t> segment(count, 0);
+	for(size_t k = 1; k + 1 < p.count; ++k) {
+		const double inner = t[k];
+		for(size_t i = 0; i < count; ++i) {
+			segment[i] += temperatures[i] >= inner ? 1 : 0;
+		}
+	}
+	if(p.count == 1) {
+		for(size_t i = 0; i < count; ++i) {
+			densities[i] = temperatures[i] == low ? a[0] : 0.;
+		}
+		return;
+	}
+	for(size_t i = 0; i < count; ++i) {
+		const double temperature = temperatures[i];
+		const bool inRange = temperature >= low && temperature <= high;
+		densities[i] = inRange ? a[segment[i]] + b[segment[i]] * temperature : 0.;
+	}
+}
@@ -0,0 +1,53 @@
+#ifndef RLC_DENSITY_TABLE_H
+#define RLC_DENSITY_TABLE_H
+
+#include <QtCore/qhash.h>
+#include <QtCore/qstring.h>
+#include <QtCore/qstringlist.h>
+#include <vector>
+
+/** Densities of products at several temperatures.
+Densities between two tabulated temperatures are interpolated linearly. The
+interpolation coefficients of every segment are computed once when the
+table is loaded, a lookup is a segment search and one multiply-add.
+Temperatures outside the tabulated range are not extrapolated.
+*/
+class DensityTable {
+public:
+	/** Temperature the specifications refer to, used if no temperature is given */
+	static constexpr double REFERENCE_TEMPERATURE = 20.;
+
+	DensityTable(void) {}
+
+	/** Load a table from a JSON file of the form
+	[{"product": "...", "densities": [{"temperature": 20, "density": 1.10}, ...]}, ...]
+	\param warnings receives a message for every product that was skipped
+	\return false if the file could not be read or parsed
+	*/
+	bool load(const QString &path, QStringList &warnings);
+
+	bool isEmpty() const {return this->productList.empty();}
+	QStringList products() const;
+	/** \return the index of the product or -1 */
+	int productIndex(const QString &name) const {return this->index.value(name, -1);}
+
+	/** \return the density in g/ml or 0 if the temperature is outside the table */
+	double lookup(int product, double temperature) const;
+	/** Look up many temperatures of one product at once */
+	void lookup(int product, const double *temperatures, size_t count, double *densities) const;
+private:
+	struct Product {
+		QString name;
+		size_t first;
+		size_t count;
+	};
+
+	std::vector<Product> productList;
+	QHash<QString, int> index;
+	// all products share these arrays, point k starts segment k
+	std::vector<double> temperatures;
+	std::vector<double> intercepts;
+	std::vector<double> slopes;
+};
+
+#endif //RLC_DENSITY_TABLE_H
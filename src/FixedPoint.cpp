@@ -0,0 +1,132 @@
+#include "FixedPoint.h"
+#include "ReleaseLimitsRule.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+/** Samples per block of evaluateBatch(), the selected limits of a block live on the stack */
+static const size_t BATCH_BLOCK = 256;
+
+qint64 toFixed(double value) {
+	// llround() of a value outside of the 64 bit range is undefined
+	static const double LIMIT = 9.2e18;
+	const double scaled = value * FIXED_ONE;
+	if(std::isnan(scaled)) {
+		return 0;
+	}
+	if(scaled >= LIMIT || scaled <= -LIMIT) {
+		return scaled > 0 ? std::numeric_limits<qint64>::max() : std::numeric_limits<qint64>::min();
+	}
+	return std::llround(scaled);
+}
+
+double fromFixed(qint64 value) {
+	return static_cast<double>(value) / FIXED_ONE;
+}
+
+qint64 fixedConvert(qint64 value, Unit from, Unit to, qint64 density) {
+	if(from == to) {
+		return value;
+	}
+	if(density <= 0) {
+		throw std::invalid_argument("The density is not a positive number of micro units.");
+	}
+	const qint64 max = std::numeric_limits<qint64>::max();
+	const qint64 magnitude = value < 0 ? -(value + 1) : value;
+	if(from == Unit::PERCENT_WW && to == Unit::g_per_l) {
+		if(density > max / 10 || magnitude > max / (10 * density)) {
+			throw std::invalid_argument("The value is too large for the fixed-point engine.");
+		}
+		return fixedDivRound(value * 10 * density, FIXED_ONE);
+	} else if(from == Unit::g_per_l && to == Unit::PERCENT_WW) {
+		if(density > max / 10 || magnitude > max / FIXED_ONE) {
+			throw std::invalid_argument("The value is too large for the fixed-point engine.");
+		}
+		return fixedDivRound(value * FIXED_ONE, 10 * density);
+	}
+	throw std::invalid_argument("Cannot convert between these units.");
+}
+
+QString fixedToString(qint64 value, unsigned int precision) {
+	if(precision > 6) {
+		precision = 6;
+	}
+	qint64 scale = 1;
+	for(unsigned int i = precision; i < 6; ++i) {
+		scale *= 10;
+	}
+	qint64 rounded = fixedDivRound(value, scale);
+	qint64 divisor = FIXED_ONE / scale;
+	qint64 magnitude = rounded < 0 ? -rounded : rounded;
+
+	QString string = QString("%1%2").arg(rounded < 0 ? "-" : "").arg(magnitude / divisor);
+	if(precision > 0) {
+		string.append('.').append(QString::number(magnitude % divisor).rightJustified(precision, '0'));
+	}
+	return string;
+}
+
+FixedPointRule::FixedPointRule(void)
+	: unit(Unit::INVALID), offsetCount(0), limitCount(0), offsets(nullptr), flags(nullptr), thresholds(nullptr)
+	, factorLow(nullptr), factorHigh(nullptr), absoluteLow(nullptr), absoluteHigh(nullptr) {
+}
+
+bool FixedPointRule::isValid() const {
+	return this->unit != Unit::INVALID;
+}
+
+void FixedPointRule::evaluate(qint64 declared, bool homogenous, qint64 *outputs) const {
+	quint8 h = homogenous ? 1 : 0;
+	this->evaluateBatch(&declared, &h, 1, outputs);
+}
+
+void FixedPointRule::evaluateBatch(const qint64 *declared, const quint8 *homogenous, size_t count, qint64 *outputs) const {
+	// in blocks, so no call (in particular the single sample of evaluate()) allocates
+	for(size_t first = 0; first < count; first += BATCH_BLOCK) {
+		const size_t n = std::min(BATCH_BLOCK, count - first);
+		this->evaluateBlock(declared + first, homogenous + first, n, outputs + first * this->offsetCount);
+	}
+}
+
+void FixedPointRule::evaluateBlock(const qint64 *declared, const quint8 *homogenous, size_t count, qint64 *outputs) const {
+	const size_t limitCount = this->limitCount;
+	const size_t outputCount = this->offsetCount;
+
+	// pass 1: find the first matching limit of every sample, branch-free
+	qint32 selected[BATCH_BLOCK];
+	std::fill(selected, selected + count, -1);
+	for(size_t k = 0; k < limitCount; ++k) {
+		const qint64 threshold = this->thresholds[k];
+		const bool all = (this->flags[k] & LIMIT_CATCH_ALL) != 0;
+		const bool inclusive = (this->flags[k] & LIMIT_INCLUSIVE) != 0;
+		const bool homogenousOnly = (this->flags[k] & LIMIT_HOMOGENOUS_ONLY) != 0;
+		const bool heterogenousOnly = (this->flags[k] & LIMIT_HETEROGENOUS_ONLY) != 0;
+		for(size_t i = 0; i < count; ++i) {
+			bool inBand = (declared[i] < threshold) | (inclusive & (declared[i] == threshold));
+			bool inGroup = !((homogenousOnly & (homogenous[i] == 0)) | (heterogenousOnly & (homogenous[i] != 0)));
+			// a catch-all limit applies regardless of homogeneity
+			bool match = (selected[i] < 0) & (all | (inBand & inGroup));
+			selected[i] = match ? static_cast<qint32>(k) : selected[i];
+		}
+	}
+
+	// pass 2: apply the tolerances of the selected limit
+	for(size_t i = 0; i < count; ++i) {
+		qint64 *row = outputs + i * outputCount;
+		const qint32 k = selected[i];
+		if(k < 0) {
+			for(size_t o = 0; o < outputCount; ++o) {
+				row[o] = declared[i];
+			}
+			continue;
+		}
+		const qint64 toleranceLow = this->absoluteLow[k] + fixedDivRound(declared[i] * this->factorLow[k], FIXED_ONE);
+		const qint64 toleranceHigh = this->absoluteHigh[k] + fixedDivRound(declared[i] * this->factorHigh[k], FIXED_ONE);
+		for(size_t o = 0; o < outputCount; ++o) {
+			const qint64 tolerance = this->offsets[o] < 0 ? toleranceLow : toleranceHigh;
+			row[o] = declared[i] + fixedDivRound(tolerance * this->offsets[o], FIXED_ONE);
+		}
+	}
+}
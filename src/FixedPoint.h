@@ -0,0 +1,87 @@
+#ifndef RLC_FIXED_POINT_H
+#define RLC_FIXED_POINT_H
+
+#include <QtCore/qglobal.h>
+#include <QtCore/qstring.h>
+#include <vector>
+
+enum class Unit : char;
+
+/** Fixed-point values are stored in micro units (value * 10^6) as 64 bit integers.
+All arithmetic is integer arithmetic with rounding half away from zero, so
+results are identical on every compiler and platform and comparisons against
+band thresholds are exact. Declared values up to FIXED_MAX_VALUE in both units
+and densities up to FIXED_MAX_DENSITY are supported without overflow, inputs
+are checked against these limits with isFixedRange() before they are evaluated.
+*/
+static const qint64 FIXED_ONE = 1000000;
+static const double FIXED_MAX_VALUE = 100000.;
+static const double FIXED_MAX_DENSITY = 1000.;
+
+/** Convert to micro units. Exact for numbers with at most six decimal places.
+Values beyond the 64 bit range (e.g. a huge threshold in a rule file) are clamped, NaN becomes 0.
+*/
+qint64 toFixed(double value);
+double fromFixed(qint64 value);
+
+/** Integer division rounding half away from zero, b must be positive */
+inline qint64 fixedDivRound(qint64 a, qint64 b) {
+	return (a >= 0 ? a + b / 2 : a - b / 2) / b;
+}
+
+/** Convert between g/l and % w/w, density in micro g/ml
+\throws std::invalid_argument if the units differ and the density is not positive, a unit is invalid
+or the result does not fit into 64 bits
+*/
+qint64 fixedConvert(qint64 value, Unit from, Unit to, qint64 density);
+
+/** Format a fixed-point value with the given number of decimal places (at most 6) */
+QString fixedToString(qint64 value, unsigned int precision);
+
+/** Flags of a compiled limit */
+enum LimitFlags : quint8 {
+	LIMIT_CATCH_ALL = 1,
+	LIMIT_INCLUSIVE = 2,
+	LIMIT_HOMOGENOUS_ONLY = 4,
+	LIMIT_HETEROGENOUS_ONLY = 8
+};
+
+/** Fixed-point version of the tolerance function of one rule.
+This is a view into the arrays of a CompiledRuleSet and only valid as long
+as the rule set is alive. The limits are parallel arrays so evaluateBatch()
+can run branch-free integer loops over many samples.
+*/
+class FixedPointRule {
+public:
+	FixedPointRule(void);
+
+	bool isValid() const;
+	Unit getUnit() const {return this->unit;}
+	size_t outputCount() const {return this->offsetCount;}
+
+	/** Evaluate one sample
+	\param declared declared value in micro units of the rule's unit, at most FIXED_MAX_VALUE
+	\param outputs receives outputCount() values in micro units of the rule's unit
+	*/
+	void evaluate(qint64 declared, bool homogenous, qint64 *outputs) const;
+	/** Evaluate many samples, outputs is row major: count rows of outputCount() values */
+	void evaluateBatch(const qint64 *declared, const quint8 *homogenous, size_t count, qint64 *outputs) const;
+private:
+	friend class CompiledRuleSet;
+
+	/** evaluateBatch() for at most BATCH_BLOCK samples */
+	void evaluateBlock(const qint64 *declared, const quint8 *homogenous, size_t count, qint64 *outputs) const;
+
+	Unit unit;
+	size_t offsetCount;
+	size_t limitCount;
+	const qint64 *offsets;
+	const quint8 *flags;
+	const qint64 *thresholds;
+	const qint64 *factorLow;
+	const qint64 *factorHigh;
+	const qint64 *absoluteLow;
+	const qint64 *absoluteHigh;
+};
+
+#endif //RLC_FIXED_POINT_H
@@ -0,0 +1,177 @@
+#include "InstanceServer.h"
+
+#include <QtCore/qdatastream.h>
+#include <QtCore/qelapsedtimer.h>
+#include <exception>
+
+static const int CONNECT_TIMEOUT = 200;
+/** Larger blocks are not a request or reply of this program */
+static const quint32 MAX_BLOCK_SIZE = 256 * 1024 * 1024;
+
+/** Read a length prefixed block, returns false if it is not yet complete.
+A block with an implausible length aborts the connection.
+*/
+static bool readBlock(QLocalSocket *socket, QByteArray &block) {
+	if(socket->bytesAvailable() < (qint64)sizeof(quint32)) {
+		return false;
+	}
+	quint32 size;
+	socket->peek(reinterpret_cast<char*>(&size), sizeof(size));
+	if(size > MAX_BLOCK_SIZE) {
+		socket->abort();
+		return false;
+	}
+	if(socket->bytesAvailable() < (qint64)(sizeof(size) + size)) {
+		return false;
+	}
+	socket->read(sizeof(size));
+	block = socket->read(size);
+	return true;
+}
+
+static void writeBlock(QLocalSocket *socket, const QByteArray &block) {
+	quint32 size = block.size();
+	socket->write(reinterpret_cast<const char*>(&size), sizeof(size));
+	socket->write(block);
+	socket->flush();
+}
+
+InstanceServer::InstanceServer(const CommandHandler &handler, QObject *parent)
+	: QObject(parent), server(new QLocalServer(this)), handler(handler), lastRequest(0) {
+	connect(this->server, SIGNAL(newConnection()), this, SLOT(acceptConnection()));
+	connect(this, SIGNAL(commandFinished(int,int,QString)), this, SLOT(sendReply(int,int,QString)), Qt::QueuedConnection);
+}
+
+InstanceServer::~InstanceServer(void) {
+	this->server->close();
+	// the jobs use the handler's objects, which outlive the server
+	for(auto it = this->requests.begin(); it != this->requests.end(); ++it) {
+		it->second.worker.join();
+	}
+}
+
+QString InstanceServer::serverName() {
+	QString user = qgetenv("USER");
+	if(user.isEmpty()) {
+		user = qgetenv("USERNAME");
+	}
+	return QString("ReleaseLimitsCalculator-%1").arg(user);
+}
+
+bool InstanceServer::listen() {
+	this->server->setSocketOptions(QLocalServer::UserAccessOption);
+	if(this->server->listen(serverName())) {
+		return true;
+	}
+	if(this->server->serverError() != QAbstractSocket::AddressInUseError) {
+		return false;
+	}
+	// a crashed instance may have left a stale socket behind, but a busy one still accepts connections
+	QLocalSocket probe;
+	probe.connectToServer(serverName());
+	if(probe.waitForConnected(CONNECT_TIMEOUT) || probe.error() != QLocalSocket::ConnectionRefusedError) {
+		probe.abort();
+		return false;
+	}
+	QLocalServer::removeServer(serverName());
+	return this->server->listen(serverName());
+}
+
+void InstanceServer::acceptConnection() {
+	while(this->server->hasPendingConnections()) {
+		QLocalSocket *socket = this->server->nextPendingConnection();
+		connect(socket, SIGNAL(readyRead()), this, SLOT(readRequest()));
+		connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+		this->handleRequest(socket);
+	}
+}
+
+void InstanceServer::readRequest() {
+	QLocalSocket *socket = qobject_cast<QLocalSocket*>(this->sender());
+	if(socket != nullptr) {
+		this->handleRequest(socket);
+	}
+}
+
+void InstanceServer::handleRequest(QLocalSocket *socket) {
+	QByteArray request;
+	if(!readBlock(socket, request)) {
+		return;
+	}
+
+	QStringList args;
+	QDataStream in(request);
+	in.setVersion(QDataStream::Qt_5_1);
+	in >> args;
+
+	// one request per connection
+	disconnect(socket, SIGNAL(readyRead()), this, SLOT(readRequest()));
+
+	Job job = this->handler(args);
+	const int id = ++this->lastRequest;
+	Request &request = this->requests[id];
+	request.socket = socket;
+	request.worker = std::thread([this, id, job]() {
+		QString output;
+		int exitCode;
+		try {
+			exitCode = job(output);
+		} catch(std::exception &e) {
+			output = QString("The program encountered an internal error.\n%1\n").arg(e.what());
+			exitCode = 1;
+		}
+		emit this->commandFinished(id, exitCode, output);
+	});
+}
+
+void InstanceServer::sendReply(int request, int exitCode, const QString &output) {
+	auto it = this->requests.find(request);
+	if(it == this->requests.end()) {
+		return;
+	}
+	it->second.worker.join();
+	QLocalSocket *socket = it->second.socket.data();
+	this->requests.erase(it);
+	if(socket == nullptr) {
+		return;
+	}
+
+	QByteArray reply;
+	QDataStream out(&reply, QIODevice::WriteOnly);
+	out.setVersion(QDataStream::Qt_5_1);
+	out << (qint32)exitCode << output;
+	writeBlock(socket, reply);
+	socket->disconnectFromServer();
+}
+
+InstanceServer::ForwardResult InstanceServer::forward(const QStringList &args, QString &output, int &exitCode) {
+	QLocalSocket socket;
+	socket.connectToServer(serverName());
+	if(!socket.waitForConnected(CONNECT_TIMEOUT)) {
+		return ForwardResult::NO_INSTANCE;
+	}
+
+	QByteArray request;
+	QDataStream out(&request, QIODevice::WriteOnly);
+	out.setVersion(QDataStream::Qt_5_1);
+	out << args;
+	writeBlock(&socket, request);
+
+	QElapsedTimer timer;
+	timer.start();
+	QByteArray reply;
+	while(!readBlock(&socket, reply)) {
+		// from here on the instance may have started the command, it must not be run a second time
+		if(timer.elapsed() > REPLY_TIMEOUT || !socket.waitForReadyRead(REPLY_TIMEOUT - timer.elapsed())) {
+			socket.abort();
+			return ForwardResult::NO_REPLY;
+		}
+	}
+
+	qint32 code;
+	QDataStream in(reply);
+	in.setVersion(QDataStream::Qt_5_1);
+	in >> code >> output;
+	exitCode = code;
+	return ForwardResult::REPLIED;
+}
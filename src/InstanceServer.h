@@ -0,0 +1,76 @@
+#ifndef RLC_INSTANCE_SERVER_H
+#define RLC_INSTANCE_SERVER_H
+
+#include <QtCore/qobject.h>
+#include <QtCore/qpointer.h>
+#include <QtCore/qstringlist.h>
+#include <QtNetwork/qlocalserver.h>
+#include <QtNetwork/qlocalsocket.h>
+#include <functional>
+#include <map>
+#include <thread>
+
+/** Local socket server of the running (warm) instance.
+Later invocations connect to it and forward their command line arguments.
+The request is a length prefixed QDataStream containing the argument list,
+the reply contains the exit code and the text output of the command.
+A command is prepared on the GUI thread (e.g. rules are loaded there) and
+then run on a worker thread, so a large forwarded batch does not freeze the
+window of the running instance.
+*/
+class InstanceServer : public QObject {
+	Q_OBJECT
+public:
+	/** Runs a prepared command, writes the result to output and returns the exit code */
+	typedef std::function<int(QString&)> Job;
+	/** Prepares forwarded arguments on the GUI thread, the job is run on a worker thread */
+	typedef std::function<Job(const QStringList&)> CommandHandler;
+
+	enum class ForwardResult {
+		/** no instance is running, the command has to be run locally */
+		NO_INSTANCE,
+		REPLIED,
+		/** the request was sent but no reply came, the command may have run (or still run) in the instance */
+		NO_REPLY
+	};
+	static const int REPLY_TIMEOUT = 60000;
+
+	InstanceServer(const CommandHandler &handler, QObject *parent = 0);
+	virtual ~InstanceServer(void);
+
+	/** Start listening, a socket left behind by a crashed instance is replaced
+	\return false if another instance is alive (even if busy) or the socket cannot be created
+	*/
+	bool listen();
+	QString errorString() const {return this->server->errorString();}
+
+	/** Name of the local socket, unique per user */
+	static QString serverName();
+
+	/** Send arguments to a running instance.
+	\return REPLIED if output and exitCode contain the reply
+	*/
+	static ForwardResult forward(const QStringList &args, QString &output, int &exitCode);
+signals:
+	/** Emitted by the worker thread of a request */
+	void commandFinished(int request, int exitCode, const QString &output);
+private slots:
+	void acceptConnection();
+	void readRequest();
+	void sendReply(int request, int exitCode, const QString &output);
+private:
+	struct Request {
+		/** null once the client disconnected */
+		QPointer<QLocalSocket> socket;
+		std::thread worker;
+	};
+
+	void handleRequest(QLocalSocket *socket);
+
+	QLocalServer *server;
+	CommandHandler handler;
+	int lastRequest;
+	std::map<int, Request> requests;
+};
+
+#endif //RLC_INSTANCE_SERVER_H
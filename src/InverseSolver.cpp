@@ -0,0 +1,264 @@
+#include "InverseSolver.h"
+#include "CompiledRuleSet.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+static const double INF = std::numeric_limits<double>::infinity();
+static const DeclaredInterval EVERYTHING = {-INF, INF, false, false};
+static const DeclaredInterval NOTHING = {1., 0., false, false};
+
+bool DeclaredInterval::isEmpty() const {
+	return this->low > this->high || (this->low == this->high && !(this->lowClosed && this->highClosed));
+}
+
+bool DeclaredInterval::contains(double value) const {
+	return (value > this->low || (value == this->low && this->lowClosed))
+		&& (value < this->high || (value == this->high && this->highClosed));
+}
+
+DeclaredInterval DeclaredInterval::roundedInward(unsigned int precision) const {
+	const double scale = std::pow(10., static_cast<int>(precision));
+	DeclaredInterval rounded = *this;
+	if(this->low > -INF) {
+		// k / scale is the double nearest to the printed value, correct ceil() for the rounding of low * scale
+		double k = std::ceil(this->low * scale);
+		if(DeclaredInterval::contains((k - 1.) / scale)) {
+			k -= 1.;
+		} else if(!DeclaredInterval::contains(k / scale)) {
+			k += 1.;
+		}
+		rounded.low = k / scale;
+		rounded.lowClosed = true;
+	}
+	if(this->high < INF) {
+		double k = std::floor(this->high * scale);
+		if(DeclaredInterval::contains((k + 1.) / scale)) {
+			k += 1.;
+		} else if(!DeclaredInterval::contains(k / scale)) {
+			k -= 1.;
+		}
+		rounded.high = k / scale;
+		rounded.highClosed = true;
+	}
+	return rounded;
+}
+
+QString DeclaredInterval::toString(unsigned int precision) const {
+	const DeclaredInterval rounded = this->roundedInward(precision);
+	QString low = rounded.low == -INF ? "-inf" : QString::number(rounded.low, 'f', precision);
+	QString high = rounded.high == INF ? "inf" : QString::number(rounded.high, 'f', precision);
+	return QString("%1%2, %3%4").arg(rounded.lowClosed ? "[" : "(").arg(low).arg(high).arg(rounded.highClosed ? "]" : ")");
+}
+
+/** Declared values for which the output slope * v + intercept is at most (below) or at least x */
+static DeclaredInterval halfLine(double slope, double intercept, double x, bool below) {
+	if(slope == 0.) {
+		return (below ? intercept <= x : intercept >= x) ? EVERYTHING : NOTHING;
+	}
+	const double root = (x - intercept) / slope;
+	if((slope > 0.) == below) {
+		DeclaredInterval interval = {-INF, root, false, true};
+		return interval;
+	}
+	DeclaredInterval interval = {root, INF, true, false};
+	return interval;
+}
+
+InverseSolver::InverseSolver(const std::vector<ReleaseLimitsRule*> &rules) {
+	if(rules.empty()) {
+		throw std::runtime_error("No rules are selected, there are no limits to solve for.");
+	}
+	for(auto rule = rules.begin(); rule != rules.end(); ++rule) {
+		const CompiledRuleSet *set = (*rule)->getRuleSet().get();
+		if(set == nullptr) {
+			throw std::runtime_error(QString("The rule %1 is not compiled.").arg((*rule)->getName()).toStdString());
+		}
+		this->addRule(*set, (*rule)->getRuleSetIndex());
+	}
+}
+
+InverseSolver::InverseSolver(const std::vector<CompiledRule> &rules) {
+	if(rules.empty()) {
+		throw std::runtime_error("No rules are selected, there are no limits to solve for.");
+	}
+	for(auto rule = rules.begin(); rule != rules.end(); ++rule) {
+		this->addRule(*rule->ruleSet, rule->index);
+	}
+}
+
+void InverseSolver::addRule(const CompiledRuleSet &set, size_t index) {
+	const CompiledRuleSet::RuleHeader &header = set.rules[index];
+	RuleBands bands;
+	bands.unit = header.unit;
+	bands.outputCount = header.outputCount;
+
+	// coefficients of every output under every limit
+	std::vector<size_t> coefficients(header.limitCount);
+	for(size_t k = 0; k < header.limitCount; ++k) {
+		const size_t l = header.firstLimit + k;
+		coefficients[k] = this->slopes.size();
+		for(size_t i = 0; i < header.outputCount; ++i) {
+			const double offset = set.offsets[header.firstOutput + i];
+			const bool low = offset < 0;
+			this->slopes.push_back(1. + (low ? set.factorLow[l] : set.factorHigh[l]) * offset);
+			this->intercepts.push_back((low ? set.absoluteLow[l] : set.absoluteHigh[l]) * offset);
+		}
+	}
+
+	// domains: the first matching limit wins, so every limit only applies above the bands before it
+	for(int homogenous = 0; homogenous < 2; ++homogenous) {
+		const quint8 excluded = homogenous ? LIMIT_HETEROGENOUS_ONLY : LIMIT_HOMOGENOUS_ONLY;
+		double cover = -INF;
+		bool coverClosed = false;
+		bool catchAll = false;
+		for(size_t k = 0; k < header.limitCount && !catchAll; ++k) {
+			const quint8 f = set.flags[header.firstLimit + k];
+			DeclaredInterval domain = {cover, INF, cover > -INF && !coverClosed, false};
+			if(f & LIMIT_CATCH_ALL) {
+				catchAll = true;
+			} else if(f & excluded) {
+				continue;
+			} else {
+				const double threshold = set.thresholds[header.firstLimit + k];
+				const bool inclusive = (f & LIMIT_INCLUSIVE) != 0;
+				domain.high = threshold;
+				domain.highClosed = inclusive;
+				if(threshold > cover || (threshold == cover && inclusive)) {
+					cover = threshold;
+					coverClosed = inclusive;
+				}
+			}
+			if(!domain.isEmpty()) {
+				Segment segment = {domain, coefficients[k]};
+				bands.segments[homogenous].push_back(segment);
+			}
+		}
+		if(catchAll) {
+			bands.unmatched[homogenous] = NOTHING;
+		} else {
+			DeclaredInterval unmatched = {cover, INF, cover > -INF && !coverClosed, false};
+			bands.unmatched[homogenous] = unmatched;
+		}
+	}
+	this->rules.push_back(bands);
+}
+
+IntervalSet InverseSolver::solve(ratio measured, double density, bool homogenous) const {
+	DeclaredInterval nonNegative = {0., INF, true, false};
+	IntervalSet feasible(1, nonNegative);
+	for(size_t r = 0; r < this->rules.size() && !feasible.empty(); ++r) {
+		feasible = intersect(feasible, this->solveRule(r, measured, density, homogenous));
+	}
+	return feasible;
+}
+
+IntervalSet InverseSolver::solveRule(size_t rule, ratio measured, double density, bool homogenous) const {
+	const RuleBands &bands = this->rules[rule];
+	const double x = measured.as(bands.unit, density);
+
+	IntervalSet feasible;
+	const std::vector<Segment> &segments = bands.segments[homogenous ? 1 : 0];
+	for(auto segment = segments.begin(); segment != segments.end(); ++segment) {
+		// x is within the limits if the smallest output is at most x and the largest at least x
+		IntervalSet below, above;
+		for(size_t i = 0; i < bands.outputCount; ++i) {
+			const double slope = this->slopes[segment->firstOutput + i];
+			const double intercept = this->intercepts[segment->firstOutput + i];
+			unite(below, intersect(segment->domain, halfLine(slope, intercept, x, true)));
+			unite(above, intersect(segment->domain, halfLine(slope, intercept, x, false)));
+		}
+		IntervalSet within = intersect(below, above);
+		for(auto it = within.begin(); it != within.end(); ++it) {
+			unite(feasible, *it);
+		}
+	}
+	if(bands.unmatched[homogenous ? 1 : 0].contains(x)) {
+		// no limit applies, every output equals the declared value
+		DeclaredInterval point = {x, x, true, true};
+		unite(feasible, point);
+	}
+
+	// to the unit of the measured value, the conversion is linear and increasing
+	for(auto it = feasible.begin(); it != feasible.end(); ++it) {
+		it->low = ratio(it->low, bands.unit).as(measured.getUnit(), density);
+		it->high = ratio(it->high, bands.unit).as(measured.getUnit(), density);
+	}
+	DeclaredInterval nonNegative = {0., INF, true, false};
+	return intersect(feasible, IntervalSet(1, nonNegative));
+}
+
+void InverseSolver::format(QTextStream &out, int targetNumber, ratio measured, const IntervalSet &declared, unsigned int precision) {
+	const QString prefix = QString("%1;%2;%3;").arg(targetNumber).arg(measured.getValue(), 0, 'f', precision)
+		.arg(measured.getUnit() == Unit::g_per_l ? "g/l" : "%w/w");
+	bool printed = false;
+	for(auto it = declared.begin(); it != declared.end(); ++it) {
+		// e.g. a single declared value that has more decimal places than printed
+		if(it->roundedInward(precision).isEmpty()) {
+			continue;
+		}
+		out << prefix << it->toString(precision) << "\n";
+		printed = true;
+	}
+	if(!printed) {
+		out << prefix << "none\n";
+	}
+}
+
+void InverseSolver::unite(IntervalSet &set, const DeclaredInterval &interval) {
+	if(interval.isEmpty()) {
+		return;
+	}
+	auto position = std::lower_bound(set.begin(), set.end(), interval, [](const DeclaredInterval &a, const DeclaredInterval &b) {
+		return a.low < b.low || (a.low == b.low && a.lowClosed && !b.lowClosed);
+	});
+	set.insert(position, interval);
+
+	IntervalSet merged;
+	merged.reserve(set.size());
+	for(auto it = set.begin(); it != set.end(); ++it) {
+		if(!merged.empty()) {
+			DeclaredInterval &last = merged.back();
+			if(it->low < last.high || (it->low == last.high && (last.highClosed || it->lowClosed))) {
+				if(it->high > last.high || (it->high == last.high && it->highClosed)) {
+					last.high = it->high;
+					last.highClosed = it->highClosed;
+				}
+				continue;
+			}
+		}
+		merged.push_back(*it);
+	}
+	set.swap(merged);
+}
+
+DeclaredInterval InverseSolver::intersect(const DeclaredInterval &a, const DeclaredInterval &b) {
+	DeclaredInterval result;
+	if(a.low != b.low) {
+		result.low = std::max(a.low, b.low);
+		result.lowClosed = a.low > b.low ? a.lowClosed : b.lowClosed;
+	} else {
+		result.low = a.low;
+		result.lowClosed = a.lowClosed && b.lowClosed;
+	}
+	if(a.high != b.high) {
+		result.high = std::min(a.high, b.high);
+		result.highClosed = a.high < b.high ? a.highClosed : b.highClosed;
+	} else {
+		result.high = a.high;
+		result.highClosed = a.highClosed && b.highClosed;
+	}
+	return result;
+}
+
+IntervalSet InverseSolver::intersect(const IntervalSet &a, const IntervalSet &b) {
+	IntervalSet result;
+	for(auto i = a.begin(); i != a.end(); ++i) {
+		for(auto j = b.begin(); j != b.end(); ++j) {
+			unite(result, intersect(*i, *j));
+		}
+	}
+	return result;
+}
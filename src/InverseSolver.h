@@ -0,0 +1,93 @@
+#ifndef RLC_INVERSE_SOLVER_H
+#define RLC_INVERSE_SOLVER_H
+
+#include <QtCore/qstring.h>
+#include <QtCore/qtextstream.h>
+#include <vector>
+
+#include "ReleaseLimitsRule.h"
+#include "CompiledRuleSet.h"
+
+/** Interval of declared values, the ends may be infinite */
+struct DeclaredInterval {
+	double low;
+	double high;
+	bool lowClosed;
+	bool highClosed;
+
+	bool isEmpty() const;
+	bool contains(double value) const;
+	/** The values with the given number of decimal places inside the interval, as closed interval.
+	Finite lower ends are rounded up and upper ends down, so every printed value is inside; the result may be empty.
+	*/
+	DeclaredInterval roundedInward(unsigned int precision) const;
+	/** roundedInward() in mathematical notation, e.g. "[1.00, 2.49]" or "[0.00, inf)" */
+	QString toString(unsigned int precision) const;
+};
+
+/** Sorted, disjoint intervals */
+typedef std::vector<DeclaredInterval> IntervalSet;
+
+/** Finds the declared values for which a measured value is within the limits.
+On the domain of every limit each output of a rule is a linear function of
+the declared value v (in the unit of the rule):
+	output = v * (1 + factor * offset) + absolute * offset
+with the low tolerance for negative and the high tolerance for other
+offsets. A measured value X is within the limits if the smallest output is
+at most X and the largest is at least X. The solver precomputes the domains
+(respecting first-match order, open and closed thresholds and homogeneity)
+and the linear coefficients of every rule, so a query only solves a few
+linear inequalities per limit.
+
+The domains and coefficients are copied from the compiled rule sets when the
+solver is constructed; the solver does not refer to the rules or rule sets
+afterwards.
+*/
+class InverseSolver {
+public:
+	/** \throws std::runtime_error if there are no rules or a rule is not compiled */
+	explicit InverseSolver(const std::vector<ReleaseLimitsRule*> &rules);
+	/** \throws std::runtime_error if there are no rules */
+	explicit InverseSolver(const std::vector<CompiledRule> &rules);
+
+	/** Declared values, in the unit of the measured value, for which the measured value is within the limits of every rule
+	\param density density of the sample, used to convert between the units
+	*/
+	IntervalSet solve(ratio measured, double density, bool homogenous) const;
+	/** Like solve() for a single rule */
+	IntervalSet solveRule(size_t rule, ratio measured, double density, bool homogenous) const;
+
+	size_t size() const {return this->rules.size();}
+
+	static const char* header() {return "target;measured;unit;declared\n";}
+	/** Write one line per interval that has a value with the given precision, or "none" if there is none */
+	static void format(QTextStream &out, int targetNumber, ratio measured, const IntervalSet &declared, unsigned int precision);
+
+	/** Add an interval to a set, merging overlapping and adjacent intervals */
+	static void unite(IntervalSet &set, const DeclaredInterval &interval);
+	static IntervalSet intersect(const IntervalSet &a, const IntervalSet &b);
+	static DeclaredInterval intersect(const DeclaredInterval &a, const DeclaredInterval &b);
+private:
+	/** Part of the domain on which one limit applies */
+	struct Segment {
+		DeclaredInterval domain;
+		/** index of the coefficients of the first output in slopes and intercepts */
+		size_t firstOutput;
+	};
+	struct RuleBands {
+		Unit unit;
+		size_t outputCount;
+		/** per homogeneity state (0: heterogenous, 1: homogenous) */
+		std::vector<Segment> segments[2];
+		/** declared values no limit applies to, the outputs are then the declared value */
+		DeclaredInterval unmatched[2];
+	};
+
+	void addRule(const CompiledRuleSet &set, size_t index);
+
+	std::vector<RuleBands> rules;
+	std::vector<double> slopes;
+	std::vector<double> intercepts;
+};
+
+#endif //RLC_INVERSE_SOLVER_H
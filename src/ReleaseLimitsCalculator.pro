@@ -1,4 +1,6 @@
-QT += core gui widgets
+QT += core gui widgets network
+
+CONFIG += c++11
 
 RESOURCES += \
     untitled.qrc
@@ -7,7 +9,20 @@ SOURCES += \
     ReleaseLimitsRule.cpp \
     mainwindow.cpp \
     main.cpp \
-    SettingsDialog.cpp
+    SettingsDialog.cpp \
+    AuditLog.cpp \
+    BatchSample.cpp \
+    InstanceServer.cpp \
+    WatchFolder.cpp \
+    FixedPoint.cpp \
+    DensityTable.cpp \
+    CompiledRuleSet.cpp \
+    RulesStreamParser.cpp \
+    WorksheetModel.cpp \
+    WorksheetDialog.cpp \
+    Verification.cpp \
+    RuleCatalog.cpp \
+    InverseSolver.cpp
 
 FORMS += \
     mainwindow.ui
@@ -18,4 +33,18 @@ OTHER_FILES += \
 HEADERS += \
     ReleaseLimitsRule.h \
     mainwindow.h \
-    SettingsDialog.h
+    SettingsDialog.h \
+    AuditLog.h \
+    BatchSample.h \
+    InstanceServer.h \
+    BoundedQueue.h \
+    WatchFolder.h \
+    FixedPoint.h \
+    DensityTable.h \
+    CompiledRuleSet.h \
+    RulesStreamParser.h \
+    WorksheetModel.h \
+    WorksheetDialog.h \
+    Verification.h \
+    RuleCatalog.h \
+    InverseSolver.h
@@ -1,11 +1,16 @@
 #include "ReleaseLimitsRule.h"
+#include "CompiledRuleSet.h"
 
 #include <qjsonarray.h>
 #include <qjsonobject.h>
 #include <qjsonvalue.h>
+#include <stdexcept>
 
 OutputValueWidget::OutputValueWidget(const QString& title, QWidget *parent) 
 	: QWidget(parent)
+	, exact(false)
+	, fixedGL(0)
+	, fixedWW(0)
 	, precision(2) {
 	mainLayout = new QGridLayout();
 	
@@ -33,20 +38,37 @@ OutputValueWidget::~OutputValueWidget(void) {
 }
 
 void OutputValueWidget::setGL(double value) {
+	this->exact = false;
 	this->valueGL = std::make_pair(true, value);
 	QString string;
 	string.setNum(value, 'f', precision);
 	this->editValueGL->setText(string);
 }
 void OutputValueWidget::setWW(double value) {
+	this->exact = false;
 	this->valueWW = std::make_pair(true, value);
 	QString string;
 	string.setNum(value, 'f', precision);
 	this->editValueWW->setText(string);
 }
 
+void OutputValueWidget::setFixed(qint64 valueGL, qint64 valueWW) {
+	this->exact = true;
+	this->fixedGL = valueGL;
+	this->fixedWW = valueWW;
+	this->valueGL = std::make_pair(true, fromFixed(valueGL));
+	this->valueWW = std::make_pair(true, fromFixed(valueWW));
+	this->editValueGL->setText(fixedToString(valueGL, this->precision));
+	this->editValueWW->setText(fixedToString(valueWW, this->precision));
+}
+
 void OutputValueWidget::updatePrecision(unsigned int precision) {
 	this->precision = precision;
+	if(this->exact) {
+		this->editValueGL->setText(fixedToString(this->fixedGL, precision));
+		this->editValueWW->setText(fixedToString(this->fixedWW, precision));
+		return;
+	}
 	if(this->valueGL.first) {
 		QString string;
 		string.setNum(this->valueGL.second, 'f', precision);
@@ -65,14 +87,15 @@ void OutputValueWidget::reset() {
 	this->editValueWW->clear();
 	this->valueGL.first = false;
 	this->valueWW.first = false;
+	this->exact = false;
 }
 
 ReleaseLimitsRule::ReleaseLimitsRule(const QString &name,
 									 const QString &info,
-									 OutputValueWidgetVector *outputWidgets,
+									 const OutputValueWidgetVector &outputWidgets,
 									 const ToleranceFunction &f,
 									 QWidget *parent)
-	:QGroupBox(parent), outputWidgets(outputWidgets), calculateValue(f), info(new QString(info)), name(name) {
+	:QGroupBox(parent), outputWidgets(outputWidgets), calculateValue(f), ruleSetIndex(0), name(name), info(info) {
 		
 	QFont font = this->font();
 	QFont bigFont = font;
@@ -81,7 +104,7 @@ ReleaseLimitsRule::ReleaseLimitsRule(const QString &name,
 	this->setFont(bigFont);
 
 	mainLayout = new QHBoxLayout();
-	for(auto it = this->outputWidgets->begin(); it != this->outputWidgets->end(); ++it) {
+	for(auto it = this->outputWidgets.begin(); it != this->outputWidgets.end(); ++it) {
 		(*it)->setFont(font);
 		mainLayout->addWidget(*it);
 	}
@@ -93,59 +116,110 @@ ReleaseLimitsRule::ReleaseLimitsRule(const QString &name,
 
 
 ReleaseLimitsRule::~ReleaseLimitsRule(void) {
-	delete this->outputWidgets;
-	delete this->info;
 }
 
-void ReleaseLimitsRule::update(ratio declared, double density, bool homogenous) {
-	//this->outputWidgets->at(0)->setWW(declared);
-	//this->outputWidgets->at(0)->setGL(density);
-	std::vector<ratio> values = this->calculateValue(declared, density, homogenous);
+void ReleaseLimitsRule::attach(const std::shared_ptr<const CompiledRuleSet> &ruleSet, size_t index) {
+	this->ruleSet = ruleSet;
+	this->ruleSetIndex = index;
+}
+
+std::vector<ratio> ReleaseLimitsRule::calculate(ratio declared, double density, bool homogenous) const {
+	if(this->ruleSet) {
+		return this->ruleSet->evaluate(this->ruleSetIndex, declared, density, homogenous);
+	}
+	if(!this->calculateValue) {
+		throw std::logic_error(QString("The rule %1 has not been compiled.").arg(this->name).toStdString());
+	}
+	return this->calculateValue(declared, density, homogenous);
+}
+
+std::vector<ratio> ReleaseLimitsRule::calculateExact(ratio declared, double density, bool homogenous) const {
+	if(!this->ruleSet) {
+		return this->calculate(declared, density, homogenous);
+	}
+	FixedPointRule exactRule = this->ruleSet->exact(this->ruleSetIndex);
+	Unit unit = exactRule.getUnit();
+	qint64 value = fixedConvert(toFixed(declared.getValue()), declared.getUnit(), unit, toFixed(density));
 
-	for(size_t i = 0; i < this->outputWidgets->size(); ++i) {
-		this->outputWidgets->at(i)->reset();
-		if(i < values.size()) {
-			this->outputWidgets->at(i)->setGL(values[i].g_l(density));
-			this->outputWidgets->at(i)->setWW(values[i].w_w(density));
+	std::vector<qint64> outputs(exactRule.outputCount());
+	exactRule.evaluate(value, homogenous, outputs.data());
+
+	std::vector<ratio> values;
+	values.reserve(outputs.size());
+	for(auto it = outputs.begin(); it != outputs.end(); ++it) {
+		values.push_back(ratio(fromFixed(*it), unit));
+	}
+	return values;
+}
+
+void ReleaseLimitsRule::display(const ratio *values, size_t count, double density, bool exact) {
+	const qint64 fixedDensity = exact ? toFixed(density) : 0;
+	for(size_t i = 0; i < this->outputWidgets.size(); ++i) {
+		this->outputWidgets.at(i)->reset();
+		if(i < count && exact) {
+			qint64 value = toFixed(values[i].getValue());
+			this->outputWidgets.at(i)->setFixed(fixedConvert(value, values[i].getUnit(), Unit::g_per_l, fixedDensity),
+				fixedConvert(value, values[i].getUnit(), Unit::PERCENT_WW, fixedDensity));
+		} else if(i < count) {
+			this->outputWidgets.at(i)->setGL(values[i].g_l(density));
+			this->outputWidgets.at(i)->setWW(values[i].w_w(density));
 		}
 	}
 }
 
+QStringList ReleaseLimitsRule::getOutputTitles() const {
+	QStringList titles;
+	for(auto it = this->outputWidgets.begin(); it != this->outputWidgets.end(); ++it) {
+		titles.append((*it)->getTitle());
+	}
+	return titles;
+}
+
 void ReleaseLimitsRule::updatePrecision(unsigned int precision) {
-	for(size_t i = 0; i < this->outputWidgets->size(); ++i) {
-		this->outputWidgets->at(i)->updatePrecision(precision);
+	for(size_t i = 0; i < this->outputWidgets.size(); ++i) {
+		this->outputWidgets.at(i)->updatePrecision(precision);
 	}
 }
 
 void ReleaseLimitsRule::reset() {
-	for(auto it = this->outputWidgets->begin(); it != this->outputWidgets->end(); ++it) {
+	for(auto it = this->outputWidgets.begin(); it != this->outputWidgets.end(); ++it) {
 		(*it)->reset();
 	}
 }
 
-enum TriState : char {
-	FALSE = 0,
-	TRUE = 1,
-	DC = -1 //don't care
-};
-
-struct RuleLimit {
-	bool catch_all;
-	bool thresh_inclusive;
-	double threshold;
-	double factor[2];
-	double absolute[2];
-	TriState homogenous;
-};
-
-typedef std::vector<RuleLimit> LimitsVector;
-
-ReleaseLimitsRule* ReleaseLimitsRuleBuilder::createFromJson(QJsonObject &obj) {
+ReleaseLimitsRule* ReleaseLimitsRuleBuilder::createFromJson(const QJsonObject &obj) {
 	if(!obj["name"].isString()) {
 		throw json_error("Key \"name\" is not a string or does not exist.");
 	}
 	this->name(obj["name"].toString());
-	
+
+	QStringList titles;
+	RuleSpec spec = parseSpec(obj, titles);
+	for(auto it = titles.begin(); it != titles.end(); ++it) {
+		this->addValue(*it);
+	}
+
+	if(obj["info"].isString()) {
+		this->info(obj["info"].toString());
+	}
+
+	ReleaseLimitsRule *rule = this->create(ReleaseLimitsRule::ToleranceFunction());
+	this->pendingRules.push_back(rule);
+	this->pendingSpecs.push_back(std::move(spec));
+	return rule;
+}
+
+std::shared_ptr<const CompiledRuleSet> ReleaseLimitsRuleBuilder::compile() {
+	std::shared_ptr<const CompiledRuleSet> ruleSet = std::make_shared<CompiledRuleSet>(this->pendingSpecs);
+	for(size_t i = 0; i < this->pendingRules.size(); ++i) {
+		this->pendingRules[i]->attach(ruleSet, i);
+	}
+	this->pendingRules.clear();
+	this->pendingSpecs.clear();
+	return ruleSet;
+}
+
+RuleSpec ReleaseLimitsRuleBuilder::parseSpec(const QJsonObject &obj, QStringList &titles) {
 	if(!obj["unit"].isString()) {
 		throw json_error("Key \"unit\" is not a string or does not exist.");
 	}
@@ -179,7 +253,7 @@ ReleaseLimitsRule* ReleaseLimitsRuleBuilder::createFromJson(QJsonObject &obj) {
 			throw json_error(QString("Key \"offset\" on output #%1 is missing or not a string.")
 				.arg(it - joutputs.begin()));
 		}
-		this->addValue(output["title"].toString());
+		titles.append(output["title"].toString());
 		outputs.push_back(output["offset"].toDouble());
 	}
 
@@ -238,22 +312,29 @@ ReleaseLimitsRule* ReleaseLimitsRuleBuilder::createFromJson(QJsonObject &obj) {
 			limit.threshold = 0.f;
 		}
 
-		limit.homogenous = TriState::DC;
+		limit.homogenous = Homogeneity::ANY;
 		if(jlimit["homogenous"].isBool() && jlimit["homogenous"].toBool()) {
-			limit.homogenous = TriState::TRUE;
+			limit.homogenous = Homogeneity::HOMOGENOUS;
 		}
 		if(jlimit["heterogenous"].isBool() && jlimit["heterogenous"].toBool()) {
-			limit.homogenous = limit.homogenous == TriState::TRUE ? TriState::DC : TriState::FALSE;
+			limit.homogenous = limit.homogenous == Homogeneity::HOMOGENOUS ? Homogeneity::ANY : Homogeneity::HETEROGENOUS;
 		}
 
 		limits.push_back(limit);
 	}
 
-	if(obj["info"].isString()) {
-		this->info(obj["info"].toString());
-	}
+	RuleSpec spec;
+	spec.unit = unit;
+	spec.outputs = std::move(outputs);
+	spec.limits = std::move(limits);
+	return spec;
+}
 
-	return this->create([outputs, limits, unit](ratio declared, double density, bool homogenous) {
+ReleaseLimitsRule::ToleranceFunction ReleaseLimitsRuleBuilder::referenceFunction(const RuleSpec &spec) {
+	Unit unit = spec.unit;
+	std::vector<double> outputs = spec.outputs;
+	LimitsVector limits = spec.limits;
+	return [outputs, limits, unit](ratio declared, double density, bool homogenous) {
 		std::vector<ratio> values(outputs.size(), declared);
 
 
@@ -261,9 +342,9 @@ ReleaseLimitsRule* ReleaseLimitsRuleBuilder::createFromJson(QJsonObject &obj) {
 			if(it->catch_all ||
 				( (declared.as(unit, density) < it->threshold ||
 				  (declared.as(unit, density) == it->threshold && it->thresh_inclusive)) && 
-					(it->homogenous == TriState::DC
-					|| (homogenous && it->homogenous == TriState::TRUE)
-					|| (!homogenous && it->homogenous == TriState::FALSE))) 
+					(it->homogenous == Homogeneity::ANY
+					|| (homogenous && it->homogenous == Homogeneity::HOMOGENOUS)
+					|| (!homogenous && it->homogenous == Homogeneity::HETEROGENOUS))) 
 				) {
 				double tolerance[2];
 				tolerance[0] = it->absolute[0] + declared.as(unit, density) * it->factor[0];
@@ -280,5 +361,5 @@ ReleaseLimitsRule* ReleaseLimitsRuleBuilder::createFromJson(QJsonObject &obj) {
 		}
 
 		return values;
-	});
+	};
 }
\ No newline at end of file
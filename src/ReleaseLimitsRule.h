@@ -6,6 +6,7 @@
 #include <QtWidgets/QGridLayout>
 #include <QtWidgets/QHBoxLayout>
 #include <qstring.h>
+#include <qstringlist.h>
 #include <QLineEdit>
 #include <QLabel>
 #include <qjsonobject.h>
@@ -13,6 +14,9 @@
 
 #include <vector>
 #include <functional>
+#include <memory>
+
+#include "FixedPoint.h"
 
 enum class Unit : char {
 	PERCENT_WW,
@@ -25,7 +29,7 @@ public:
 	ratio(double value, Unit u) : value(value), u(u) {};
 	~ratio(void){};
 	
-	double g_l(double density) {
+	double g_l(double density) const {
 		if(this->u == Unit::g_per_l) {
 			return value;
 		} else if (u == Unit::PERCENT_WW){
@@ -33,7 +37,7 @@ public:
 		}
 		throw;
 	}
-	double w_w(double density) {
+	double w_w(double density) const {
 		if(this->u == Unit::g_per_l) {
 			return value/(10.f*density);
 		} else if (u == Unit::PERCENT_WW){
@@ -41,7 +45,7 @@ public:
 		}
 		throw;
 	}
-	double as(Unit unit, double density) {
+	double as(Unit unit, double density) const {
 		if(unit == Unit::g_per_l) {
 			return this->g_l(density);
 		} else if (unit == Unit::PERCENT_WW) {
@@ -49,6 +53,8 @@ public:
 		}
 		throw;
 	}
+	double getValue() const {return value;}
+	Unit getUnit() const {return u;}
 private:
 	double value;
 	Unit u;
@@ -64,8 +70,11 @@ public:
 
 	void setGL(double value);
 	void setWW(double value);
+	/** Set both values in micro units, they are rounded with fixedToString() */
+	void setFixed(qint64 valueGL, qint64 valueWW);
 	void updatePrecision(unsigned int precision);
 	void reset();
+	QString getTitle() const {return this->labelTitle->text();}
 private:
 	QGridLayout *mainLayout;
 	QLabel *labelTitle;
@@ -76,9 +85,40 @@ private:
 
 	std::pair<bool, double> valueGL;
 	std::pair<bool, double> valueWW;
+	/** set by setFixed(), the values are then shown from fixedGL and fixedWW */
+	bool exact;
+	qint64 fixedGL;
+	qint64 fixedWW;
 	unsigned int precision;
 };
 
+/** Homogeneity a limit applies to */
+enum class Homogeneity : char {
+	HETEROGENOUS = 0,
+	HOMOGENOUS = 1,
+	ANY = -1
+};
+
+struct RuleLimit {
+	bool catch_all;
+	bool thresh_inclusive;
+	double threshold;
+	double factor[2];
+	double absolute[2];
+	Homogeneity homogenous;
+};
+
+typedef std::vector<RuleLimit> LimitsVector;
+
+/** Numeric part of a rule as read from the rule file */
+struct RuleSpec {
+	Unit unit;
+	std::vector<double> outputs;
+	LimitsVector limits;
+};
+
+class CompiledRuleSet;
+
 class ReleaseLimitsRule : public QGroupBox {
 	Q_OBJECT
 public:
@@ -89,38 +129,57 @@ public:
 	typedef std::function<std::vector<ratio>(ratio, double, bool)> ToleranceFunction;
 	typedef std::vector<OutputValueWidget*> OutputValueWidgetVector;
 
-	ReleaseLimitsRule(const QString &name, const QString &info, OutputValueWidgetVector *outputWidgets, const ToleranceFunction &f, QWidget *parent = 0);
+	ReleaseLimitsRule(const QString &name, const QString &info, const OutputValueWidgetVector &outputWidgets, const ToleranceFunction &f, QWidget *parent = 0);
 	virtual ~ReleaseLimitsRule(void);
 
-	/** Calculate limit and set line edits accordingly
-	\param declared The declared value
-	\param density the density of the declared content. 0 means not density provided.
-	\param percentWW if true the parameter declared has the unit % w/w, else it has the unit g/l
-	\param homogenous if true calculate for homogenous else for heterogenous
+	/** Set the line edits to calculated values
+	\param values the values in the order of the output widgets
+	\param density the density of the sample, used to show the values in both units
+	\param exact convert and round the values with fixed-point arithmetic
+	*/
+	void display(const ratio *values, size_t count, double density, bool exact = false);
+	/** Calculate limits without touching the widgets, may be called from any thread.
+	Uses the compiled rule set if the rule is attached to one, else the tolerance function.
+	\throws std::logic_error if the rule was created by createFromJson() and not compiled yet
 	*/
-	void update(ratio declared, double density, bool homogenous);
+	std::vector<ratio> calculate(ratio declared, double density, bool homogenous) const;
+	/** Like calculate() but evaluated with the fixed-point engine.
+	Inputs are rounded to micro units, the values are returned in the unit of the rule.
+	Falls back to calculate() if the rule has no fixed-point representation.
+	*/
+	std::vector<ratio> calculateExact(ratio declared, double density, bool homogenous) const;
 	void updatePrecision(unsigned int precision);
 	void reset();
+
+	/** Evaluate through the given rule set generation from now on */
+	void attach(const std::shared_ptr<const CompiledRuleSet> &ruleSet, size_t index);
+	const std::shared_ptr<const CompiledRuleSet>& getRuleSet() const {return this->ruleSet;}
+	size_t getRuleSetIndex() const {return this->ruleSetIndex;}
 	
-	QString getInfo() {return *this->info;}
+	QString getInfo() {return this->info;}
 	QString getName() {return this->name;}
+	QStringList getOutputTitles() const;
 protected:
 	QHBoxLayout *mainLayout;
 
-	OutputValueWidgetVector *outputWidgets;
+	OutputValueWidgetVector outputWidgets;
 	ToleranceFunction calculateValue;
+	std::shared_ptr<const CompiledRuleSet> ruleSet;
+	size_t ruleSetIndex;
 	const QString name;
-	const QString *info;
+	const QString info;
 };
 
 class ReleaseLimitsRuleBuilder {
 public:
-	ReleaseLimitsRuleBuilder(void) : outputWidgets(new ReleaseLimitsRule::OutputValueWidgetVector()){};
-	~ReleaseLimitsRuleBuilder(void) {if(outputWidgets != nullptr) delete outputWidgets;};
+	ReleaseLimitsRuleBuilder(void) {};
+	~ReleaseLimitsRuleBuilder(void) {this->reset();};
 
 	ReleaseLimitsRuleBuilder& reset(void) {
-		if(outputWidgets != nullptr) delete outputWidgets;
-		this->outputWidgets = new ReleaseLimitsRule::OutputValueWidgetVector();
+		for(auto it = this->outputWidgets.begin(); it != this->outputWidgets.end(); ++it) {
+			delete *it;
+		}
+		this->outputWidgets.clear();
 		this->nameString = QString();
 		this->infoString = QString();
 		return *this;
@@ -137,17 +196,29 @@ public:
 
 	ReleaseLimitsRuleBuilder& addValue(const QString & title) {
 		OutputValueWidget* w = new OutputValueWidget(title);
-		this->outputWidgets->push_back(w);
+		this->outputWidgets.push_back(w);
 
 		return *this;
 	};
 	ReleaseLimitsRule* create(const ReleaseLimitsRule::ToleranceFunction &f) {
 		ReleaseLimitsRule* instance = new ReleaseLimitsRule(this->nameString, this->infoString, this->outputWidgets, f);
-		outputWidgets = nullptr;
+		this->outputWidgets.clear();
 		this->reset();
 		return instance;
 	};
-	ReleaseLimitsRule* createFromJson(QJsonObject &obj);
+	/** Create a rule from its JSON description.
+	The rule cannot calculate before compile() was called.
+	*/
+	ReleaseLimitsRule* createFromJson(const QJsonObject &obj);
+	/** Compile all rules created by createFromJson() since the last call into one rule set generation */
+	std::shared_ptr<const CompiledRuleSet> compile();
+
+	/** Parse the numeric part of a rule and the titles of its outputs
+	\throws json_error
+	*/
+	static RuleSpec parseSpec(const QJsonObject &obj, QStringList &titles);
+	/** The original closure based tolerance function of a rule, kept as reference implementation */
+	static ReleaseLimitsRule::ToleranceFunction referenceFunction(const RuleSpec &spec);
 
 	struct json_error : public std::exception {
 		json_error(const char* msg) : msg (msg) {}
@@ -157,9 +228,11 @@ public:
 		const char* what() {return this->msg.toStdString().c_str();}
 	};
 private:
-	ReleaseLimitsRule::OutputValueWidgetVector *outputWidgets;
+	ReleaseLimitsRule::OutputValueWidgetVector outputWidgets;
 	QString nameString;
 	QString infoString;
+	std::vector<ReleaseLimitsRule*> pendingRules;
+	std::vector<RuleSpec> pendingSpecs;
 };
 
 #endif //_RELEASELIMITSCALCULATOR_RELEASELIMITSRULE_H_
\ No newline at end of file
@@ -0,0 +1,269 @@
+#include "RuleCatalog.h"
+#include "AuditLog.h"
+#include "CompiledRuleSet.h"
+#include "RulesStreamParser.h"
+
+#include <QtCore/qdir.h>
+#include <QtCore/qfile.h>
+#include <QtCore/qjsonarray.h>
+#include <QtCore/qjsondocument.h>
+#include <QtCore/qjsonobject.h>
+#include <algorithm>
+#include <map>
+
+/** Bytes read at once when a single rule file is hashed */
+static const qint64 HASH_CHUNK_SIZE = 65536;
+
+RuleCatalog::RuleCatalog(void)
+	: singleFile(false), indexHash(AuditLog::hash(QByteArray())), peakRule(0), compiledSize(0) {
+}
+
+bool RuleCatalog::openDirectory(const QString &directory, QStringList &warnings) {
+	QDir dir(directory);
+	QFile indexFile(dir.filePath("index.json"));
+	if(!indexFile.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+	QByteArray data = indexFile.readAll();
+	QJsonParseError jerr;
+	QJsonDocument doc = QJsonDocument::fromJson(data, &jerr);
+	if(jerr.error != QJsonParseError::NoError || !doc.isArray()) {
+		warnings.append(QString("Error while parising the rule index %1.\n%2").arg(indexFile.fileName())
+			.arg(jerr.error != QJsonParseError::NoError ? jerr.errorString() : "Top level element is not an array."));
+		return false;
+	}
+
+	this->singleFile = false;
+	this->directory = dir.path();
+	this->indexHash = AuditLog::hash(data);
+	QHash<QString, int> fileIndex;
+	QJsonArray arr = doc.array();
+	for(auto it = arr.begin(); it != arr.end(); ++it) {
+		QJsonObject entry = (*it).toObject();
+		if(!entry["name"].isString() || !entry["file"].isString()) {
+			warnings.append(QString("The rule index %1 has errors.\nSkipping entry #%2.\n"
+				"Keys \"name\" and \"file\" must be strings.").arg(indexFile.fileName()).arg(it - arr.begin()));
+			continue;
+		}
+		QString name = entry["name"].toString();
+		if(this->indexOf(name) >= 0) {
+			warnings.append(QString("The rule index %1 has errors.\nSkipping entry #%2.\n"
+				"The rule %3 is listed twice.").arg(indexFile.fileName()).arg(it - arr.begin()).arg(name));
+			continue;
+		}
+		QString file = entry["file"].toString();
+		if(!fileIndex.contains(file)) {
+			fileIndex.insert(file, this->files.size());
+			this->files.append(file);
+		}
+		this->addEntry(name, fileIndex.value(file), nullptr);
+	}
+	this->filesRead.assign(this->files.size(), false);
+	return true;
+}
+
+void RuleCatalog::openFile(const QString &path) {
+	this->singleFile = true;
+	this->directory = QString();
+	this->files = QStringList(path);
+	this->filesRead.assign(1, false);
+
+	// the file takes the place of the index, hash it before any rule is loaded; in chunks, so it is never in memory at once
+	this->indexHash = AuditLog::hash(QByteArray());
+	QFile file(path);
+	if(file.open(QIODevice::ReadOnly)) {
+		while(!file.atEnd()) {
+			const QByteArray chunk = file.read(HASH_CHUNK_SIZE);
+			if(chunk.isEmpty()) {
+				break;
+			}
+			this->indexHash = AuditLog::hash(chunk, this->indexHash);
+		}
+	}
+}
+
+QStringList RuleCatalog::names() const {
+	QStringList list;
+	for(auto it = this->entries.begin(); it != this->entries.end(); ++it) {
+		list.append(it->name);
+	}
+	return list;
+}
+
+int RuleCatalog::indexOf(const QString &name) const {
+	const quint64 hash = AuditLog::hash(name);
+	for(auto it = this->byHash.find(hash); it != this->byHash.end() && it.key() == hash; ++it) {
+		if(this->entries[it.value()].name == name) {
+			return it.value();
+		}
+	}
+	return -1;
+}
+
+bool RuleCatalog::isLoaded(const QString &name) const {
+	int index = this->indexOf(name);
+	return index >= 0 && this->entries[index].rule != nullptr;
+}
+
+void RuleCatalog::addEntry(const QString &name, int file, ReleaseLimitsRule *rule) {
+	Entry entry = {name, file, rule};
+	this->byHash.insert(AuditLog::hash(name), static_cast<int>(this->entries.size()));
+	this->entries.push_back(entry);
+}
+
+std::map<int, QSet<QString>> RuleCatalog::filesOf(const QStringList &names, const std::function<bool (const Entry&)> &filter) const {
+	// requested rules grouped by file, every file is read at most once per call
+	std::map<int, QSet<QString>> wanted;
+	for(auto it = names.begin(); it != names.end(); ++it) {
+		int index = this->indexOf(*it);
+		if(index >= 0 && filter(this->entries[index])) {
+			wanted[this->entries[index].file].insert(*it);
+		}
+	}
+	return wanted;
+}
+
+std::vector<ReleaseLimitsRule*> RuleCatalog::load(const QStringList &names, QStringList &warnings) {
+	std::map<int, QSet<QString>> wanted;
+	if(this->singleFile) {
+		if(!this->filesRead[0]) {
+			wanted[0];
+		}
+	} else {
+		wanted = this->filesOf(names, [](const Entry &entry) {return entry.rule == nullptr;});
+	}
+
+	ReleaseLimitsRuleBuilder builder;
+	std::vector<ReleaseLimitsRule*> loaded;
+	for(auto it = wanted.begin(); it != wanted.end(); ++it) {
+		this->loadFile(it->first, it->second, builder, loaded, warnings);
+	}
+	if(!loaded.empty()) {
+		this->compiledSize += builder.compile()->memoryUsage();
+	}
+	return loaded;
+}
+
+void RuleCatalog::loadFile(int file, const QSet<QString> &wanted, ReleaseLimitsRuleBuilder &builder,
+						   std::vector<ReleaseLimitsRule*> &loaded, QStringList &warnings) {
+	const QString fileName = this->files.at(file);
+	QSet<QString> found;
+	bool parsed = this->readFile(file, warnings, [&](const QJsonObject &obj, int index) {
+		const QString name = obj["name"].toString();
+		const int entry = this->singleFile ? -1 : this->indexOf(name);
+		if(!this->singleFile && (!wanted.contains(name) || this->entries[entry].rule != nullptr)) {
+			// not requested: neither built nor compiled
+			return;
+		}
+		found.insert(name);
+		try {
+			ReleaseLimitsRule *rule = builder.createFromJson(obj);
+			if(this->singleFile) {
+				this->addEntry(rule->getName(), file, rule);
+			} else {
+				this->entries[entry].rule = rule;
+			}
+			loaded.push_back(rule);
+		} catch (ReleaseLimitsRuleBuilder::json_error &e) {
+			warnings.append(QString("The configuration file %1 has errors.\n"
+				"Skipping rule #%2.\n%3").arg(fileName).arg(index).arg(e.qwhat()));
+			builder.reset();
+		}
+	});
+	for(auto it = wanted.begin(); it != wanted.end() && parsed; ++it) {
+		if(!found.contains(*it)) {
+			warnings.append(QString("The configuration file %1 has no rule %2.").arg(fileName).arg(*it));
+		}
+	}
+}
+
+bool RuleCatalog::readFile(int file, QStringList &warnings, const std::function<void (const QJsonObject&, int)> &visit) {
+	const QString fileName = this->files.at(file);
+	QFile ruleFile(this->singleFile ? fileName : QDir(this->directory).filePath(fileName));
+	if(!ruleFile.open(QIODevice::ReadOnly)) {
+		warnings.append(QString("The configuration file %1 was not found.").arg(fileName));
+		return false;
+	}
+
+	RulesStreamParser parser;
+	bool parsed = parser.parse(&ruleFile, [&](const QJsonValue &value, int index) {
+		if(!value.isObject()) {
+			warnings.append(QString("The configuration file %1 has errors.\n"
+				"Skipping rule #%2.\nArray element is not an object.").arg(fileName).arg(index));
+			return true;
+		}
+		visit(value.toObject(), index);
+		return true;
+	});
+	ruleFile.close();
+
+	this->filesRead[file] = true;
+	this->peakRule = std::max(this->peakRule, parser.peakElementSize());
+	if(!parsed) {
+		warnings.append(QString("Error while parising the configuration file %1.\n%2").arg(fileName).arg(parser.errorString()));
+	}
+	return parsed;
+}
+
+std::vector<CompiledRule> RuleCatalog::compile(const QStringList &names, QStringList &warnings) {
+	std::map<int, QSet<QString>> wanted;
+	if(this->singleFile) {
+		wanted[0] = QSet<QString>::fromList(names);
+	} else {
+		wanted = this->filesOf(names.isEmpty() ? this->names() : names, [](const Entry&) {return true;});
+	}
+
+	std::vector<RuleSpec> specs;
+	std::vector<CompiledRule> compiled;
+	for(auto it = wanted.begin(); it != wanted.end(); ++it) {
+		const QString fileName = this->files.at(it->first);
+		const QSet<QString> &requested = it->second;
+		QSet<QString> found;
+		bool parsed = this->readFile(it->first, warnings, [&](const QJsonObject &obj, int index) {
+			const QString name = obj["name"].toString();
+			if(!requested.isEmpty() && !requested.contains(name)) {
+				// only a single rule file without names compiles all of its rules
+				return;
+			}
+			found.insert(name);
+			try {
+				if(!obj["name"].isString()) {
+					throw ReleaseLimitsRuleBuilder::json_error("Key \"name\" is not a string or does not exist.");
+				}
+				CompiledRule rule = {nullptr, specs.size(), name, QStringList()};
+				specs.push_back(ReleaseLimitsRuleBuilder::parseSpec(obj, rule.titles));
+				compiled.push_back(rule);
+			} catch (ReleaseLimitsRuleBuilder::json_error &e) {
+				warnings.append(QString("The configuration file %1 has errors.\n"
+					"Skipping rule #%2.\n%3").arg(fileName).arg(index).arg(e.qwhat()));
+			}
+		});
+		for(auto name = requested.begin(); name != requested.end() && parsed; ++name) {
+			if(!found.contains(*name)) {
+				warnings.append(QString("The configuration file %1 has no rule %2.").arg(fileName).arg(*name));
+			}
+		}
+	}
+
+	std::shared_ptr<const CompiledRuleSet> ruleSet = std::make_shared<CompiledRuleSet>(specs);
+	for(auto it = compiled.begin(); it != compiled.end(); ++it) {
+		it->ruleSet = ruleSet;
+	}
+	if(!this->singleFile) {
+		// files are read in file order, the catalogue defines the display order
+		std::stable_sort(compiled.begin(), compiled.end(), [this](const CompiledRule &a, const CompiledRule &b) {
+			return this->indexOf(a.name) < this->indexOf(b.name);
+		});
+	}
+	return compiled;
+}
+
+std::vector<ReleaseLimitsRule*> RuleCatalog::loadedRules() const {
+	std::vector<ReleaseLimitsRule*> rules;
+	for(auto it = this->entries.begin(); it != this->entries.end(); ++it) {
+		if(it->rule != nullptr) {
+			rules.push_back(it->rule);
+		}
+	}
+	return rules;
+}
@@ -0,0 +1,101 @@
+#ifndef RLC_RULE_CATALOG_H
+#define RLC_RULE_CATALOG_H
+
+#include <QtCore/qhash.h>
+#include <QtCore/qset.h>
+#include <QtCore/qstring.h>
+#include <QtCore/qstringlist.h>
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "ReleaseLimitsRule.h"
+#include "CompiledRuleSet.h"
+
+/** All rules known to the application and the ones loaded so far.
+The rules either come from a directory of rule files with an index
+(rules/index.json) or from a single rule file (rules.json).
+
+The index lists the name and the file of every rule in display order:
+[{"name": "...", "file": "eu.json"}, ...]
+Each file has the format of rules.json and may hold any number of rules.
+Only the index is read on start-up; a rule is parsed and compiled when it is
+first requested, so start-up cost depends on the rules shown and not on the
+size of the catalogue. Rules are looked up by the hash of their name,
+names with the same hash are chained.
+
+A single rule file has no index, all of its rules are loaded on the first
+call of load().
+*/
+class RuleCatalog {
+public:
+	RuleCatalog(void);
+
+	/** Read the index of a rule directory
+	\param warnings receives a message for every index entry that was skipped
+	\return false if the directory has no readable index
+	*/
+	bool openDirectory(const QString &directory, QStringList &warnings);
+	/** Take all rules from one rule file */
+	void openFile(const QString &path);
+
+	/** Names of all rules in display order (for a single file: of the loaded rules) */
+	QStringList names() const;
+	/** \return the position of the rule in names() or -1 */
+	int indexOf(const QString &name) const;
+	bool isLoaded(const QString &name) const;
+
+	/** Parse the named rules that are not loaded yet and compile them as one new rule set generation.
+	Unknown names are ignored.
+	\param warnings receives a message for every rule that was skipped and every file that could not be read
+	\return the rules created by this call
+	*/
+	std::vector<ReleaseLimitsRule*> load(const QStringList &names, QStringList &warnings);
+	/** All loaded rules in display order */
+	std::vector<ReleaseLimitsRule*> loadedRules() const;
+	/** Parse and compile the named rules without creating widgets, e.g. for a process without GUI.
+	The rules are not marked as loaded. Unknown names are ignored.
+	\param names the rules to compile, all rules of the catalogue if empty
+	\param warnings receives a message for every rule that was skipped and every file that could not be read
+	\return the compiled rules in display order
+	*/
+	std::vector<CompiledRule> compile(const QStringList &names, QStringList &warnings);
+
+	/** FNV-1a hash of the index (of the rule file without index), see AuditLog::hash().
+	It is known after opening and does not change while rules are loaded.
+	*/
+	quint64 getHash() const {return this->indexHash;}
+	/** Size of the largest rule held in memory while parsing */
+	int peakRuleSize() const {return this->peakRule;}
+	/** Bytes held by all compiled rule set generations */
+	size_t memoryUsage() const {return this->compiledSize;}
+private:
+	struct Entry {
+		QString name;
+		int file;
+		ReleaseLimitsRule *rule;
+	};
+
+	void addEntry(const QString &name, int file, ReleaseLimitsRule *rule);
+	void loadFile(int file, const QSet<QString> &wanted, ReleaseLimitsRuleBuilder &builder,
+		std::vector<ReleaseLimitsRule*> &loaded, QStringList &warnings);
+	/** Stream the rules of a file and pass every rule object with its position to visit.
+	Missing files and parse errors are reported in warnings.
+	\return false if the file could not be read completely
+	*/
+	bool readFile(int file, QStringList &warnings, const std::function<void (const QJsonObject&, int)> &visit);
+	/** Files to read for the named rules that the filter accepts, with the requested names per file */
+	std::map<int, QSet<QString>> filesOf(const QStringList &names, const std::function<bool (const Entry&)> &filter) const;
+
+	bool singleFile;
+	QString directory;
+	quint64 indexHash;
+	std::vector<Entry> entries;
+	QMultiHash<quint64, int> byHash;
+	QStringList files;
+	std::vector<bool> filesRead;
+	int peakRule;
+	size_t compiledSize;
+};
+
+#endif //RLC_RULE_CATALOG_H
@@ -0,0 +1,173 @@
+#include "RulesStreamParser.h"
+#include "AuditLog.h"
+
+#include <QtCore/qjsonarray.h>
+#include <QtCore/qjsondocument.h>
+#include <QtCore/qjsonobject.h>
+
+enum class ScanState {
+	BEFORE_ARRAY,
+	BEFORE_ELEMENT,
+	AFTER_ELEMENT,
+	IN_ELEMENT,
+	DONE
+};
+
+static bool isSpace(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+RulesStreamParser::RulesStreamParser(int chunkSize)
+	: chunkSize(chunkSize), hash(0), peakElement(0), elementStart(0), elementIndex(0) {
+}
+
+bool RulesStreamParser::parse(QIODevice *device, const ElementHandler &handler) {
+	this->error = QString();
+	this->hash = AuditLog::hash(QByteArray());
+	this->peakElement = 0;
+	this->elementIndex = 0;
+	this->element.clear();
+
+	ScanState state = ScanState::BEFORE_ARRAY;
+	int depth = 0;
+	bool inString = false;
+	bool escaped = false;
+	bool scalar = false;
+	bool expectElement = false;
+	qint64 position = 0;
+
+	while(!device->atEnd() && state != ScanState::DONE) {
+		QByteArray chunk = device->read(this->chunkSize);
+		if(chunk.isEmpty()) {
+			break;
+		}
+		this->hash = AuditLog::hash(chunk, this->hash);
+
+		const char *data = chunk.constData();
+		int copyFrom = state == ScanState::IN_ELEMENT ? 0 : -1;
+		for(int i = 0; i < chunk.size() && state != ScanState::DONE; ++i, ++position) {
+			const char c = data[i];
+			switch(state) {
+			case ScanState::BEFORE_ARRAY:
+				if(position == 0 && c == '\xEF') {
+					// UTF-8 byte order mark
+					i += 2;
+					position += 2;
+				} else if(c == '[') {
+					state = ScanState::BEFORE_ELEMENT;
+				} else if(!isSpace(c)) {
+					this->error = "Top level element is not an array.";
+					return false;
+				}
+				break;
+			case ScanState::BEFORE_ELEMENT:
+			case ScanState::AFTER_ELEMENT:
+				if(isSpace(c)) {
+					break;
+				} else if(c == ']' && !expectElement) {
+					state = ScanState::DONE;
+				} else if(c == ',' && state == ScanState::AFTER_ELEMENT) {
+					state = ScanState::BEFORE_ELEMENT;
+					expectElement = true;
+				} else if(state == ScanState::BEFORE_ELEMENT && c != ']' && c != ',') {
+					state = ScanState::IN_ELEMENT;
+					expectElement = false;
+					this->elementStart = position;
+					copyFrom = i;
+					depth = 0;
+					inString = false;
+					escaped = false;
+					scalar = c != '{' && c != '[';
+					--i;
+					--position;
+				} else {
+					this->error = QString("Unexpected character '%1' at offset %2.").arg(QChar(c)).arg(position);
+					return false;
+				}
+				break;
+			case ScanState::IN_ELEMENT:
+				if(inString) {
+					if(escaped) {
+						escaped = false;
+					} else if(c == '\\') {
+						escaped = true;
+					} else if(c == '"') {
+						inString = false;
+					}
+				} else if(c == '"') {
+					inString = true;
+				} else if(c == '{' || c == '[') {
+					++depth;
+				} else if((c == '}' || c == ']') && depth > 0) {
+					--depth;
+					if(depth == 0 && !scalar) {
+						this->element.append(data + copyFrom, i + 1 - copyFrom);
+						copyFrom = -1;
+						bool stop = false;
+						if(!this->finishElement(handler, stop)) {
+							return false;
+						}
+						state = stop ? ScanState::DONE : ScanState::AFTER_ELEMENT;
+					}
+				} else if(scalar && (c == ',' || c == ']')) {
+					// numbers and literals end at the next separator, which is scanned again
+					this->element.append(data + copyFrom, i - copyFrom);
+					copyFrom = -1;
+					bool stop = false;
+					if(!this->finishElement(handler, stop)) {
+						return false;
+					}
+					state = stop ? ScanState::DONE : ScanState::AFTER_ELEMENT;
+					--i;
+					--position;
+				}
+				break;
+			case ScanState::DONE:
+				break;
+			}
+		}
+		if(state == ScanState::IN_ELEMENT && copyFrom >= 0) {
+			this->element.append(data + copyFrom, chunk.size() - copyFrom);
+			if(this->element.size() > this->peakElement) {
+				this->peakElement = this->element.size();
+			}
+		}
+	}
+
+	if(state != ScanState::DONE) {
+		this->error = state == ScanState::BEFORE_ARRAY ? "Top level element is not an array." : "Unexpected end of file.";
+		return false;
+	}
+	return true;
+}
+
+bool RulesStreamParser::finishElement(const ElementHandler &handler, bool &stop) {
+	if(this->element.size() > this->peakElement) {
+		this->peakElement = this->element.size();
+	}
+
+	QJsonValue value;
+	QByteArray trimmed = this->element.trimmed();
+	if(trimmed.startsWith('{') || trimmed.startsWith('[')) {
+		QJsonParseError jerr;
+		QJsonDocument doc = QJsonDocument::fromJson(trimmed, &jerr);
+		if(jerr.error != QJsonParseError::NoError) {
+			this->error = QString("%1 at offset %2.").arg(jerr.errorString()).arg(this->elementStart + jerr.offset);
+			return false;
+		}
+		value = doc.isObject() ? QJsonValue(doc.object()) : QJsonValue(doc.array());
+	} else {
+		// a scalar, QJsonDocument cannot parse it on its own
+		QJsonParseError jerr;
+		QJsonDocument doc = QJsonDocument::fromJson("[" + trimmed + "]", &jerr);
+		if(jerr.error != QJsonParseError::NoError) {
+			this->error = QString("%1 at offset %2.").arg(jerr.errorString()).arg(this->elementStart);
+			return false;
+		}
+		value = doc.array().at(0);
+	}
+	this->element.clear();
+
+	stop = !handler(value, this->elementIndex++);
+	return true;
+}
@@ -0,0 +1,49 @@
+#ifndef RLC_RULES_STREAM_PARSER_H
+#define RLC_RULES_STREAM_PARSER_H
+
+#include <QtCore/qbytearray.h>
+#include <QtCore/qiodevice.h>
+#include <QtCore/qjsonvalue.h>
+#include <QtCore/qstring.h>
+#include <functional>
+
+/** Reads a rule file (a JSON array of rules) incrementally.
+The device is read in chunks and scanned for the boundaries of the top-level
+array elements. Only one element at a time is materialized and handed to
+the callback, so the memory needed is proportional to the largest rule and
+not to the size of the file.
+*/
+class RulesStreamParser {
+public:
+	/** Called for every element of the top-level array
+	\param value the element, usually an object
+	\param index position of the element in the array
+	\return false to stop parsing
+	*/
+	typedef std::function<bool(const QJsonValue &value, int index)> ElementHandler;
+
+	explicit RulesStreamParser(int chunkSize = 65536);
+
+	/** \return false on a syntax error, see errorString() */
+	bool parse(QIODevice *device, const ElementHandler &handler);
+
+	QString errorString() const {return this->error;}
+	/** FNV-1a hash of the bytes read, see AuditLog::hash(). Reading stops with the chunk that
+	holds the end of the array or the element the handler stopped at, the rest of the file is not hashed.
+	*/
+	quint64 getHash() const {return this->hash;}
+	/** Size of the largest element held in memory at once */
+	int peakElementSize() const {return this->peakElement;}
+private:
+	bool finishElement(const ElementHandler &handler, bool &stop);
+
+	int chunkSize;
+	QString error;
+	quint64 hash;
+	int peakElement;
+	qint64 elementStart;
+	int elementIndex;
+	QByteArray element;
+};
+
+#endif //RLC_RULES_STREAM_PARSER_H
@@ -0,0 +1,608 @@
+#include "Verification.h"
+#include "AuditLog.h"
+#include "BatchSample.h"
+#include "InverseSolver.h"
+#include "RulesStreamParser.h"
+
+#include <QtCore/qbuffer.h>
+#include <QtCore/qelapsedtimer.h>
+#include <QtCore/qfile.h>
+#include <QtCore/qjsondocument.h>
+#include <QtCore/qsavefile.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+const double Verification::FIXED_TOLERANCE = 1e-5;
+const double Verification::INVERSE_TOLERANCE = 1e-9;
+
+static const int MAX_REPORTED_MISMATCHES = 10;
+/** decimal places of the BatchEvaluator under test, the most FixedPoint can print */
+static const unsigned int PUBLIC_PRECISION = 6;
+/** only every n-th sample is formatted, formatting dominates the run time otherwise */
+static const size_t PUBLIC_FORMAT_STRIDE = 10;
+static const qint64 MIN_BENCHMARK_MSECS = 300;
+
+/** Run f until at least MIN_BENCHMARK_MSECS have passed
+\return evaluations per second
+*/
+template<typename F>
+static double measure(F f, quint64 evaluationsPerRound) {
+	QElapsedTimer timer;
+	quint64 rounds = 0;
+	timer.start();
+	do {
+		f();
+		++rounds;
+	} while(timer.elapsed() < MIN_BENCHMARK_MSECS || rounds < 3);
+	return static_cast<double>(evaluationsPerRound * rounds) / (timer.nsecsElapsed() / 1e9);
+}
+
+static QString unitName(Unit unit) {
+	return unit == Unit::g_per_l ? "g/l" : "%w/w";
+}
+
+/** The value of the set closest to value, NaN for an empty set */
+static double closest(const IntervalSet &set, double value) {
+	double best = std::numeric_limits<double>::quiet_NaN();
+	for(auto it = set.begin(); it != set.end(); ++it) {
+		const double candidate = std::min(std::max(value, it->low), it->high);
+		if(std::isnan(best) || std::fabs(candidate - value) < std::fabs(best - value)) {
+			best = candidate;
+		}
+	}
+	return best;
+}
+
+Verification::Verification(const Options &options, QTextStream &out)
+	: options(options), out(out), random(options.seed), checks(0), mismatches(0) {
+	this->pathNames << "reference" << "compiled" << "compiledAll" << "fixedBatch";
+}
+
+int Verification::run() {
+	this->out << "Verifying " << this->options.ruleSets << " random rule sets (seed " << this->options.seed << ")\n";
+	this->out.flush();
+
+	std::vector<GeneratedSet> sets(this->options.ruleSets);
+	bool generated = true;
+	for(auto it = sets.begin(); it != sets.end() && generated; ++it) {
+		generated = this->buildSet(*it);
+		if(generated) {
+			this->compare(*it, it->inputs);
+			this->compareFixed(*it, it->inputs);
+			this->comparePublic(*it, it->inputs);
+			this->compareInverse(*it, it->inputs);
+		}
+	}
+	this->out << this->checks << " values compared, " << this->mismatches << " mismatches.\n";
+	if(!generated || this->mismatches > 0) {
+		return 1;
+	}
+
+	this->benchmark(sets);
+	return this->checkBaseline() ? 0 : 1;
+}
+
+double Verification::uniform(double low, double high, double step) {
+	const qint64 scale = std::llround(1. / step);
+	std::uniform_int_distribution<qint64> distribution(std::llround(low * scale), std::llround(high * scale));
+	// divide instead of multiplying by step, the result is then the double nearest to the decimal value
+	return static_cast<double>(distribution(this->random)) / scale;
+}
+
+QJsonObject Verification::randomRule(int number) {
+	static const double OFFSETS[] = {-2., -1., -0.5, 0., 0.5, 1., 2.};
+	std::uniform_int_distribution<int> pick(0, 99);
+
+	QJsonObject rule;
+	Unit unit = pick(this->random) < 50 ? Unit::g_per_l : Unit::PERCENT_WW;
+	const double range = unit == Unit::g_per_l ? 1000. : 100.;
+	rule["name"] = QString("Generated %1").arg(number);
+	rule["info"] = QString("Generated rule %1").arg(number);
+	rule["unit"] = unitName(unit);
+
+	QJsonArray outputs;
+	const int outputCount = 1 + pick(this->random) % 4;
+	for(int i = 0; i < outputCount; ++i) {
+		QJsonObject output;
+		output["title"] = QString("Output %1").arg(i + 1);
+		output["offset"] = OFFSETS[pick(this->random) % (sizeof(OFFSETS) / sizeof(OFFSETS[0]))];
+		outputs.append(output);
+	}
+	rule["outputs"] = outputs;
+
+	const int limitCount = 1 + pick(this->random) % 6;
+	std::vector<double> thresholds;
+	for(int i = 0; i < limitCount; ++i) {
+		thresholds.push_back(this->uniform(0., range, 0.001));
+	}
+	// rule files usually list the bands in ascending order, but the first match wins either way
+	if(pick(this->random) < 70) {
+		std::sort(thresholds.begin(), thresholds.end());
+	}
+
+	QJsonArray limits;
+	for(int i = 0; i < limitCount; ++i) {
+		QJsonObject limit;
+		const int bound = pick(this->random) % 5;
+		if(bound < 2) {
+			limit["lte"] = thresholds[i];
+		} else if(bound < 4) {
+			limit["lt"] = thresholds[i];
+		}
+
+		QJsonObject percent, absolute;
+		percent["-"] = this->uniform(0., 20., 0.01);
+		percent["+"] = this->uniform(0., 20., 0.01);
+		absolute["-"] = this->uniform(0., range / 20., 0.001);
+		absolute["+"] = this->uniform(0., range / 20., 0.001);
+		switch(pick(this->random) % 6) {
+		case 0:
+			limit["percent"] = percent.value("-");
+			break;
+		case 1:
+			limit["absolute"] = absolute.value("-");
+			break;
+		case 2:
+			limit["percent"] = percent.value("-");
+			limit["absolute"] = absolute.value("+");
+			break;
+		case 3:
+			limit["percent"] = percent;
+			break;
+		case 4:
+			limit["absolute"] = absolute;
+			break;
+		default:
+			limit["percent"] = percent;
+			limit["absolute"] = absolute;
+			break;
+		}
+
+		switch(pick(this->random) % 6) {
+		case 2:
+			limit["homogenous"] = true;
+			break;
+		case 3:
+			limit["heterogenous"] = true;
+			break;
+		case 4:
+			limit["homogenous"] = true;
+			limit["heterogenous"] = true;
+			break;
+		case 5:
+			limit["homogenous"] = false;
+			break;
+		}
+		limits.append(limit);
+	}
+	rule["limits"] = limits;
+	return rule;
+}
+
+std::vector<Verification::Input> Verification::randomInputs(const std::vector<RuleSpec> &specs) {
+	std::vector<Input> inputs;
+	std::uniform_int_distribution<int> pick(0, 1);
+
+	// adversarial values: on, next to and one micro unit away from every threshold, in both units
+	for(auto spec = specs.begin(); spec != specs.end(); ++spec) {
+		const Unit other = spec->unit == Unit::g_per_l ? Unit::PERCENT_WW : Unit::g_per_l;
+		for(auto limit = spec->limits.begin(); limit != spec->limits.end(); ++limit) {
+			if(limit->catch_all) {
+				continue;
+			}
+			const double t = limit->threshold;
+			const double values[] = {
+				t, t - 1e-6, t + 1e-6,
+				std::nextafter(t, -std::numeric_limits<double>::infinity()),
+				std::nextafter(t, std::numeric_limits<double>::infinity())
+			};
+			for(size_t v = 0; v < sizeof(values) / sizeof(values[0]); ++v) {
+				const double density = this->uniform(0.8, 1.6, 0.0001);
+				const ratio declared(values[v], spec->unit);
+				for(int homogenous = 0; homogenous < 2; ++homogenous) {
+					Input same = {declared, density, homogenous != 0};
+					Input converted = {ratio(declared.as(other, density), other), density, homogenous != 0};
+					inputs.push_back(same);
+					inputs.push_back(converted);
+				}
+			}
+		}
+	}
+
+	for(int i = 0; i < this->options.samples; ++i) {
+		const Unit unit = pick(this->random) ? Unit::g_per_l : Unit::PERCENT_WW;
+		const double value = this->uniform(0., unit == Unit::g_per_l ? 1000. : 100., 0.000001);
+		Input input = {ratio(value, unit), this->uniform(0.8, 1.6, 0.0001), pick(this->random) != 0};
+		inputs.push_back(input);
+	}
+	return inputs;
+}
+
+bool Verification::buildSet(GeneratedSet &set) {
+	std::uniform_int_distribution<int> pick(1, 8);
+	const int ruleCount = pick(this->random);
+	for(int i = 0; i < ruleCount; ++i) {
+		set.json.append(this->randomRule(i + 1));
+	}
+
+	// read the rules back the way the application does, in small chunks so rules straddle chunk boundaries
+	QByteArray data = QJsonDocument(set.json).toJson();
+	QBuffer buffer(&data);
+	buffer.open(QIODevice::ReadOnly);
+	RulesStreamParser parser(7 + pick(this->random) * 5);
+	QJsonArray parsed;
+	bool ok = parser.parse(&buffer, [&parsed](const QJsonValue &value, int) {
+		parsed.append(value);
+		return true;
+	});
+	// the parser stops reading after the chunk with the closing bracket
+	if(!ok || parsed != set.json || parser.getHash() != AuditLog::hash(data.left(static_cast<int>(buffer.pos())))) {
+		this->out << "RulesStreamParser does not reproduce the generated rule file"
+			<< (ok ? QString() : ": " + parser.errorString()) << "\n" << data << "\n";
+		++this->mismatches;
+		return false;
+	}
+
+	for(auto it = parsed.begin(); it != parsed.end(); ++it) {
+		QStringList titles;
+		try {
+			set.specs.push_back(ReleaseLimitsRuleBuilder::parseSpec((*it).toObject(), titles));
+		} catch(ReleaseLimitsRuleBuilder::json_error &e) {
+			this->out << "Generated rule rejected: " << e.qwhat() << "\n"
+				<< QJsonDocument((*it).toObject()).toJson(QJsonDocument::Compact) << "\n";
+			++this->mismatches;
+			return false;
+		}
+		set.reference.push_back(ReleaseLimitsRuleBuilder::referenceFunction(set.specs.back()));
+	}
+	set.compiled = std::make_shared<CompiledRuleSet>(set.specs);
+	set.inputs = this->randomInputs(set.specs);
+	return true;
+}
+
+void Verification::compare(const GeneratedSet &set, const std::vector<Input> &inputs) {
+	std::vector<double> all(set.compiled->totalOutputs());
+	for(auto input = inputs.begin(); input != inputs.end(); ++input) {
+		set.compiled->evaluateAll(input->declared, input->density, input->homogenous, all.data());
+		for(size_t r = 0; r < set.specs.size(); ++r) {
+			const Unit unit = set.specs[r].unit;
+			std::vector<ratio> expected = set.reference[r](input->declared, input->density, input->homogenous);
+			std::vector<ratio> actual = set.compiled->evaluate(r, input->declared, input->density, input->homogenous);
+			const double *actualAll = all.data() + set.compiled->outputOffset(r);
+			for(size_t i = 0; i < expected.size(); ++i) {
+				this->checks += 2;
+				if(i >= actual.size() || actual[i].getUnit() != expected[i].getUnit()
+					|| actual[i].getValue() != expected[i].getValue()) {
+					this->mismatch(set, r, *input, "CompiledRuleSet::evaluate", expected[i].getValue(),
+						i < actual.size() ? actual[i].getValue() : std::numeric_limits<double>::quiet_NaN());
+				}
+				if(actualAll[i] != expected[i].as(unit, input->density)) {
+					this->mismatch(set, r, *input, "CompiledRuleSet::evaluateAll", expected[i].as(unit, input->density), actualAll[i]);
+				}
+			}
+		}
+	}
+}
+
+void Verification::compareFixed(const GeneratedSet &set, const std::vector<Input> &inputs) {
+	for(size_t r = 0; r < set.specs.size(); ++r) {
+		FixedPointRule rule = set.compiled->exact(r);
+		if(!rule.isValid()) {
+			continue;
+		}
+		// every input is rounded to micro units and converted to the rule's unit the way BatchEvaluator does,
+		// the reference then gets the value the engine actually sees
+		std::vector<qint64> declared(inputs.size());
+		std::vector<quint8> homogenous(inputs.size());
+		for(size_t k = 0; k < inputs.size(); ++k) {
+			const Input &input = inputs[k];
+			declared[k] = fixedConvert(toFixed(input.declared.getValue()), input.declared.getUnit(), rule.getUnit(), toFixed(input.density));
+			homogenous[k] = input.homogenous ? 1 : 0;
+
+			++this->checks;
+			const double converted = input.declared.as(rule.getUnit(), input.density);
+			if(std::fabs(fromFixed(declared[k]) - converted) > FIXED_TOLERANCE) {
+				this->mismatch(set, r, input, "fixedConvert", converted, fromFixed(declared[k]));
+			}
+		}
+
+		std::vector<qint64> outputs(inputs.size() * rule.outputCount());
+		rule.evaluateBatch(declared.data(), homogenous.data(), inputs.size(), outputs.data());
+		for(size_t k = 0; k < inputs.size(); ++k) {
+			const Input &input = inputs[k];
+			std::vector<ratio> expected = set.reference[r](ratio(fromFixed(declared[k]), rule.getUnit()),
+				fromFixed(toFixed(input.density)), input.homogenous);
+			for(size_t i = 0; i < expected.size(); ++i) {
+				++this->checks;
+				const double actual = fromFixed(outputs[k * rule.outputCount() + i]);
+				if(std::fabs(actual - expected[i].getValue()) > FIXED_TOLERANCE) {
+					this->mismatch(set, r, input, "FixedPointRule::evaluateBatch", expected[i].getValue(), actual);
+				}
+			}
+		}
+	}
+}
+
+void Verification::comparePublic(const GeneratedSet &set, const std::vector<Input> &inputs) {
+	// the rules the way the window creates them; owned here, they have no parent widget
+	ReleaseLimitsRuleBuilder builder;
+	std::vector<std::unique_ptr<ReleaseLimitsRule>> widgets;
+	std::vector<ReleaseLimitsRule*> attached;
+	std::vector<CompiledRule> rules;
+	for(int r = 0; r < set.json.size(); ++r) {
+		widgets.emplace_back(builder.createFromJson(set.json.at(r).toObject()));
+		attached.push_back(widgets.back().get());
+		CompiledRule rule = {set.compiled, static_cast<size_t>(r), widgets.back()->getName(), widgets.back()->getOutputTitles()};
+		rules.push_back(rule);
+	}
+	// the widgets get the rule set the builder compiled from them, as in the window
+	builder.compile();
+
+	std::vector<BatchSample> samples(inputs.size());
+	for(size_t k = 0; k < inputs.size(); ++k) {
+		samples[k].declared = inputs[k].declared;
+		samples[k].density = inputs[k].density;
+		samples[k].densityGiven = true;
+		samples[k].homogenous = inputs[k].homogenous;
+	}
+
+	// both engines, for the compiled rules of the generated set and for the rules of the window
+	for(int variant = 0; variant < 4; ++variant) {
+		const bool exact = (variant & 1) != 0;
+		const bool window = (variant & 2) != 0;
+		const QString path = QString("BatchEvaluator::evaluate (%1%2)").arg(window ? "window rules" : "compiled rules").arg(exact ? ", exact" : "");
+		const BatchEvaluator evaluator = window
+			? BatchEvaluator(attached, PUBLIC_PRECISION, nullptr, AuditSource::BATCH, exact)
+			: BatchEvaluator(rules, PUBLIC_PRECISION, nullptr, AuditSource::BATCH, exact);
+		std::vector<BatchEvaluator::Result> results(samples.size());
+		evaluator.evaluate(samples.data(), samples.size(), results.data());
+
+		for(size_t k = 0; k < inputs.size(); ++k) {
+			const Input &input = inputs[k];
+			for(size_t r = 0; r < widgets.size(); ++r) {
+				// calculate() is held to the reference bit by bit, calculateExact() like compareFixed() on the rounded input
+				std::vector<ratio> expected, reference;
+				if(exact) {
+					const Unit unit = set.specs[r].unit;
+					const qint64 declared = fixedConvert(toFixed(input.declared.getValue()), input.declared.getUnit(), unit, toFixed(input.density));
+					expected = widgets[r]->calculateExact(input.declared, input.density, input.homogenous);
+					reference = set.reference[r](ratio(fromFixed(declared), unit), fromFixed(toFixed(input.density)), input.homogenous);
+				} else {
+					expected = widgets[r]->calculate(input.declared, input.density, input.homogenous);
+					reference = set.reference[r](input.declared, input.density, input.homogenous);
+				}
+				const ratio *actual = results[k].data() + evaluator.outputOffset(r);
+				for(size_t i = 0; i < expected.size(); ++i) {
+					// the widgets are held to the reference once per engine
+					this->checks += window ? 1 : 2;
+					const double tolerance = exact ? FIXED_TOLERANCE : 0.;
+					if(!window && (expected[i].getUnit() != reference[i].getUnit() || std::fabs(expected[i].getValue() - reference[i].getValue()) > tolerance)) {
+						this->mismatch(set, r, input, exact ? "ReleaseLimitsRule::calculateExact" : "ReleaseLimitsRule::calculate",
+							reference[i].getValue(), expected[i].getValue());
+					}
+					if(i >= evaluator.outputCount(r) || actual[i].getUnit() != expected[i].getUnit()
+						|| actual[i].getValue() != expected[i].getValue()) {
+						this->mismatch(set, r, input, path, expected[i].getValue(),
+							i < evaluator.outputCount(r) ? actual[i].getValue() : std::numeric_limits<double>::quiet_NaN());
+					}
+				}
+			}
+
+			// the written text has to give the values back, in both units
+			if(k % PUBLIC_FORMAT_STRIDE != 0) {
+				continue;
+			}
+			QString text;
+			QTextStream out(&text);
+			evaluator.format(out, static_cast<int>(k + 1), samples[k], results[k]);
+			out.flush();
+			const QStringList lines = text.split('\n', QString::SkipEmptyParts);
+			size_t line = 0;
+			for(size_t r = 0; r < rules.size(); ++r) {
+				for(size_t i = 0; i < evaluator.outputCount(r); ++i, ++line) {
+					const ratio &value = results[k][evaluator.outputOffset(r) + i];
+					const QStringList fields = line < static_cast<size_t>(lines.size()) ? lines.at(static_cast<int>(line)).split(';') : QStringList();
+					const double gl = value.as(Unit::g_per_l, input.density);
+					const double ww = value.as(Unit::PERCENT_WW, input.density);
+					// one digit in the last place for the rounding of the text, the fixed-point conversion rounds once more
+					const double tolerance = std::pow(10., -static_cast<int>(PUBLIC_PRECISION)) + (exact ? FIXED_TOLERANCE : 0.);
+					this->checks += 2;
+					if(fields.size() != 5 || fields.at(0) != QString::number(k + 1) || fields.at(1) != rules[r].name
+						|| fields.at(2) != rules[r].titles.at(static_cast<int>(i))) {
+						this->mismatch(set, r, input, "BatchEvaluator::format: " + (fields.isEmpty() ? "missing line" : fields.join(";")), gl,
+							std::numeric_limits<double>::quiet_NaN());
+						continue;
+					}
+					if(std::fabs(fields.at(3).toDouble() - gl) > tolerance) {
+						this->mismatch(set, r, input, "BatchEvaluator::format (g/l)", gl, fields.at(3).toDouble());
+					}
+					if(std::fabs(fields.at(4).toDouble() - ww) > tolerance) {
+						this->mismatch(set, r, input, "BatchEvaluator::format (% w/w)", ww, fields.at(4).toDouble());
+					}
+				}
+			}
+		}
+	}
+}
+
+void Verification::compareInverse(const GeneratedSet &set, const std::vector<Input> &inputs) {
+	std::vector<CompiledRule> rules;
+	for(size_t r = 0; r < set.specs.size(); ++r) {
+		CompiledRule rule = {set.compiled, r, set.json.at(static_cast<int>(r)).toObject()["name"].toString(), QStringList()};
+		rules.push_back(rule);
+	}
+	const InverseSolver solver(rules);
+	std::uniform_int_distribution<int> pick(0, 99);
+
+	for(auto input = inputs.begin(); input != inputs.end(); ++input) {
+		for(size_t r = 0; r < set.specs.size(); ++r) {
+			// one output per rule and sample, measured in a random unit
+			std::vector<ratio> outputs = set.compiled->evaluate(r, input->declared, input->density, input->homogenous);
+			const ratio output = outputs[pick(this->random) % outputs.size()];
+			const Unit unit = pick(this->random) < 50 ? Unit::g_per_l : Unit::PERCENT_WW;
+			const double measured = output.as(unit, input->density);
+			const double expected = input->declared.as(unit, input->density);
+			const double tolerance = INVERSE_TOLERANCE * std::max(1., std::fabs(expected));
+
+			++this->checks;
+			const double actual = closest(solver.solveRule(r, ratio(measured, unit), input->density, input->homogenous), expected);
+			if(!std::isnan(actual) && std::fabs(actual - expected) <= tolerance) {
+				continue;
+			}
+			// a declared value on a band edge may lose its output to rounding, the neighbouring outputs must still find it
+			const double step = 1e-12 * std::max(1., std::fabs(measured));
+			bool found = false;
+			for(int sign = -1; sign <= 1 && !found; sign += 2) {
+				const double nearby = closest(solver.solveRule(r, ratio(measured + sign * step, unit), input->density, input->homogenous), expected);
+				found = !std::isnan(nearby) && std::fabs(nearby - expected) <= tolerance;
+			}
+			if(!found) {
+				this->mismatch(set, r, *input, QString("InverseSolver::solveRule (measured %1 %2)")
+					.arg(measured, 0, 'g', 17).arg(unitName(unit)), expected, actual);
+			}
+		}
+	}
+}
+
+void Verification::mismatch(const GeneratedSet &set, size_t rule, const Input &input, const QString &path,
+							double expected, double actual) {
+	if(++this->mismatches > MAX_REPORTED_MISMATCHES) {
+		return;
+	}
+	this->out << "MISMATCH in " << path << ": expected " << QString::number(expected, 'g', 17)
+		<< ", got " << QString::number(actual, 'g', 17) << "\n"
+		<< "  declared " << QString::number(input.declared.getValue(), 'g', 17) << " " << unitName(input.declared.getUnit())
+		<< ", density " << input.density << ", " << (input.homogenous ? "homogenous" : "heterogenous") << "\n"
+		<< "  rule " << QJsonDocument(set.json.at(static_cast<int>(rule)).toObject()).toJson(QJsonDocument::Compact) << "\n";
+}
+
+void Verification::benchmark(const std::vector<GeneratedSet> &sets) {
+	quint64 evaluations = 0;
+	std::vector<std::vector<std::vector<qint64>>> declared(sets.size());
+	std::vector<std::vector<quint8>> homogenous(sets.size());
+	size_t maxOutputs = 0;
+	for(size_t s = 0; s < sets.size(); ++s) {
+		const GeneratedSet &set = sets[s];
+		evaluations += set.specs.size() * set.inputs.size();
+		for(auto input = set.inputs.begin(); input != set.inputs.end(); ++input) {
+			homogenous[s].push_back(input->homogenous ? 1 : 0);
+		}
+		for(size_t r = 0; r < set.specs.size(); ++r) {
+			std::vector<qint64> values;
+			for(auto input = set.inputs.begin(); input != set.inputs.end(); ++input) {
+				values.push_back(toFixed(input->declared.as(set.specs[r].unit, input->density)));
+			}
+			declared[s].push_back(std::move(values));
+			maxOutputs = std::max(maxOutputs, set.inputs.size() * set.compiled->outputCount(r));
+		}
+	}
+
+	volatile double sink = 0.;
+	std::vector<double> all;
+	std::vector<qint64> fixedOutputs(maxOutputs);
+	this->throughput.clear();
+
+	this->throughput.push_back(measure([&]() {
+		for(auto set = sets.begin(); set != sets.end(); ++set) {
+			for(auto input = set->inputs.begin(); input != set->inputs.end(); ++input) {
+				for(size_t r = 0; r < set->reference.size(); ++r) {
+					sink = sink + set->reference[r](input->declared, input->density, input->homogenous).front().getValue();
+				}
+			}
+		}
+	}, evaluations));
+
+	this->throughput.push_back(measure([&]() {
+		for(auto set = sets.begin(); set != sets.end(); ++set) {
+			for(auto input = set->inputs.begin(); input != set->inputs.end(); ++input) {
+				for(size_t r = 0; r < set->compiled->size(); ++r) {
+					sink = sink + set->compiled->evaluate(r, input->declared, input->density, input->homogenous).front().getValue();
+				}
+			}
+		}
+	}, evaluations));
+
+	this->throughput.push_back(measure([&]() {
+		for(auto set = sets.begin(); set != sets.end(); ++set) {
+			all.resize(set->compiled->totalOutputs());
+			for(auto input = set->inputs.begin(); input != set->inputs.end(); ++input) {
+				set->compiled->evaluateAll(input->declared, input->density, input->homogenous, all.data());
+				sink = sink + all.front();
+			}
+		}
+	}, evaluations));
+
+	this->throughput.push_back(measure([&]() {
+		for(size_t s = 0; s < sets.size(); ++s) {
+			for(size_t r = 0; r < sets[s].compiled->size(); ++r) {
+				sets[s].compiled->exact(r).evaluateBatch(declared[s][r].data(), homogenous[s].data(),
+					sets[s].inputs.size(), fixedOutputs.data());
+				sink = sink + fixedOutputs.front();
+			}
+		}
+	}, evaluations));
+}
+
+bool Verification::checkBaseline() {
+	// machines differ in speed, the speed-up of every path over the reference path does much less
+	QJsonObject measured;
+	measured["relativeTo"] = this->pathNames.at(0);
+	for(int i = 1; i < this->pathNames.size(); ++i) {
+		measured[this->pathNames.at(i)] = this->throughput[i] / this->throughput[0];
+	}
+
+	QJsonObject baseline;
+	bool compareBaseline = !this->options.baseline.isEmpty() && !this->options.updateBaseline;
+	if(compareBaseline) {
+		QFile file(this->options.baseline);
+		if(file.open(QIODevice::ReadOnly)) {
+			baseline = QJsonDocument::fromJson(file.readAll()).object();
+			if(baseline["relativeTo"].toString() != this->pathNames.at(0)) {
+				this->out << "The baseline " << this->options.baseline << " holds no speed-ups against the "
+					<< this->pathNames.at(0) << " path, record it again with --update-baseline.\n";
+				compareBaseline = false;
+			}
+		} else {
+			// first run: record the baseline
+			this->out << "No baseline " << this->options.baseline << ", recording the current speed-ups.\n";
+			compareBaseline = false;
+			this->options.updateBaseline = true;
+		}
+	}
+
+	bool passed = true;
+	for(int i = 0; i < this->pathNames.size(); ++i) {
+		const QString &name = this->pathNames.at(i);
+		this->out << name.leftJustified(12) << QString::number(this->throughput[i] / 1e6, 'f', 2).rightJustified(10)
+			<< " M evaluations/s";
+		if(i > 0) {
+			const double speedup = this->throughput[i] / this->throughput[0];
+			this->out << ", " << QString::number(speedup, 'f', 2) << "x " << this->pathNames.at(0);
+			if(compareBaseline && baseline[name].isDouble()) {
+				const double base = baseline[name].toDouble();
+				const double change = (speedup - base) / base;
+				this->out << " (" << (change >= 0 ? "+" : "") << QString::number(change * 100., 'f', 1) << "% against baseline)";
+				if(change < -this->options.threshold) {
+					this->out << " REGRESSION";
+					passed = false;
+				}
+			}
+		}
+		this->out << "\n";
+	}
+
+	if(this->options.updateBaseline && !this->options.baseline.isEmpty()) {
+		QSaveFile file(this->options.baseline);
+		if(!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(measured).toJson()) < 0 || !file.commit()) {
+			this->out << "Cannot write the baseline " << this->options.baseline << ".\n" << file.errorString() << "\n";
+			return false;
+		}
+		this->out << "Baseline written to " << this->options.baseline << ".\n";
+	}
+	if(!passed) {
+		this->out << "A speed-up against the " << this->pathNames.at(0) << " path dropped by more than "
+			<< this->options.threshold * 100. << "% against the baseline.\n";
+	}
+	return passed;
+}
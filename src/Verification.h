@@ -0,0 +1,104 @@
+#ifndef RLC_VERIFICATION_H
+#define RLC_VERIFICATION_H
+
+#include <QtCore/qjsonarray.h>
+#include <QtCore/qjsonobject.h>
+#include <QtCore/qstring.h>
+#include <QtCore/qtextstream.h>
+
+#include <functional>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "ReleaseLimitsRule.h"
+#include "CompiledRuleSet.h"
+
+/** Differential check and benchmark of the rule evaluation engines.
+Random rule sets are generated in the rule file format and read back through
+RulesStreamParser and ReleaseLimitsRuleBuilder::parseSpec(). Every rule is
+then evaluated by the reference tolerance function and by the optimized
+paths:
+- CompiledRuleSet::evaluate() and evaluateAll() must return bit identical values,
+- FixedPointRule must agree within FIXED_TOLERANCE with the reference evaluated
+  on the input rounded to micro units and converted by fixedConvert(),
+- ReleaseLimitsRule::calculate(), calculateExact() and BatchEvaluator (both
+  engines, values and formatted text) must agree with the paths above,
+- InverseSolver::solveRule() must return the declared value for every output
+  of the rule, measured in either unit (within INVERSE_TOLERANCE).
+Inputs include values on, just below and just above every lte/lt threshold,
+in both units and for both homogeneity states.
+
+The public entry points need rule widgets, run() needs a QApplication.
+
+Afterwards the throughput of every path is measured. The speed-up of every
+path over the reference path is compared against a baseline file, so the
+baseline holds on machines of different speed; a speed-up below the baseline
+by more than the threshold counts as a failure.
+*/
+class Verification {
+public:
+	static const double FIXED_TOLERANCE;
+	/** relative, the solver divides by the slope of an output and converts units twice */
+	static const double INVERSE_TOLERANCE;
+
+	struct Options {
+		Options(void) : seed(1), ruleSets(200), samples(1000), updateBaseline(false), threshold(0.25) {}
+
+		quint64 seed;
+		int ruleSets;
+		/** random inputs per rule set, in addition to the threshold values */
+		int samples;
+		/** JSON file with the speed-up of every path over the reference path, empty for no comparison */
+		QString baseline;
+		/** write the measured speed-ups to the baseline file instead of comparing */
+		bool updateBaseline;
+		/** allowed relative drop of a speed-up against the baseline */
+		double threshold;
+	};
+
+	Verification(const Options &options, QTextStream &out);
+
+	/** Run all checks and the benchmark
+	\return 0 if everything matched and no path regressed, 1 otherwise
+	*/
+	int run();
+private:
+	struct Input {
+		ratio declared;
+		double density;
+		bool homogenous;
+	};
+	struct GeneratedSet {
+		QJsonArray json;
+		std::vector<RuleSpec> specs;
+		std::vector<ReleaseLimitsRule::ToleranceFunction> reference;
+		std::shared_ptr<const CompiledRuleSet> compiled;
+		std::vector<Input> inputs;
+	};
+
+	QJsonObject randomRule(int number);
+	std::vector<Input> randomInputs(const std::vector<RuleSpec> &specs);
+	bool buildSet(GeneratedSet &set);
+	void compare(const GeneratedSet &set, const std::vector<Input> &inputs);
+	void compareFixed(const GeneratedSet &set, const std::vector<Input> &inputs);
+	/** ReleaseLimitsRule::calculate(), calculateExact() and BatchEvaluator with both engines, including format() */
+	void comparePublic(const GeneratedSet &set, const std::vector<Input> &inputs);
+	void compareInverse(const GeneratedSet &set, const std::vector<Input> &inputs);
+	void benchmark(const std::vector<GeneratedSet> &sets);
+	bool checkBaseline();
+
+	void mismatch(const GeneratedSet &set, size_t rule, const Input &input, const QString &path, double expected, double actual);
+	double uniform(double low, double high, double step);
+
+	Options options;
+	QTextStream &out;
+	std::mt19937_64 random;
+
+	quint64 checks;
+	quint64 mismatches;
+	QStringList pathNames;
+	std::vector<double> throughput;
+};
+
+#endif //RLC_VERIFICATION_H
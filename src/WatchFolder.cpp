@@ -0,0 +1,365 @@
+#include "WatchFolder.h"
+
+#include <QtCore/qdatetime.h>
+#include <QtCore/qdir.h>
+#include <QtCore/qfile.h>
+#include <QtCore/qfileinfo.h>
+#include <QtCore/qsavefile.h>
+#include <QtCore/qtextstream.h>
+#include <stdexcept>
+#include <utility>
+
+static const int SCAN_INTERVAL = 1000;
+/** Files modified more recently are assumed to be still written by the instrument */
+static const qint64 SETTLE_TIME = 1000;
+static const char RESULT_SUFFIX[] = ".results.csv";
+
+WatchFolder::WatchFolder(const QString &directory, const QString &outputDirectory, const BatchEvaluator &evaluator, QObject *parent)
+	: QObject(parent)
+	, directory(QDir(directory).absolutePath())
+	, outputDirectory(QDir(outputDirectory).absolutePath())
+	, evaluator(evaluator)
+	, watcher(new QFileSystemWatcher(this))
+	, timer(new QTimer(this))
+	, files(QUEUE_CAPACITY)
+	, readQueue(QUEUE_CAPACITY)
+	, parseQueue(QUEUE_CAPACITY)
+	, evaluateQueue(QUEUE_CAPACITY)
+	, formatQueue(QUEUE_CAPACITY)
+	, stopping(false) {
+	connect(this->watcher, SIGNAL(directoryChanged(const QString&)), this, SLOT(scan()));
+	connect(this->timer, SIGNAL(timeout()), this, SLOT(scan()));
+}
+
+WatchFolder::~WatchFolder(void) {
+	this->stop();
+}
+
+bool WatchFolder::start() {
+	if(!QFileInfo(this->directory).isDir()) {
+		this->error = QString("The directory %1 does not exist.").arg(this->directory);
+		return false;
+	}
+	if(!QDir().mkpath(this->outputDirectory)) {
+		this->error = QString("The output directory %1 could not be created.").arg(this->outputDirectory);
+		return false;
+	}
+	this->loadCheckpoint();
+
+	this->threads.push_back(std::thread(&WatchFolder::readStage, this));
+	this->threads.push_back(std::thread(&WatchFolder::parseStage, this));
+	this->threads.push_back(std::thread(&WatchFolder::evaluateStage, this));
+	this->threads.push_back(std::thread(&WatchFolder::formatStage, this));
+	this->threads.push_back(std::thread(&WatchFolder::writeStage, this));
+
+	this->watcher->addPath(this->directory);
+	this->timer->start(SCAN_INTERVAL);
+	this->scan();
+	return true;
+}
+
+void WatchFolder::stop() {
+	if(this->threads.empty()) {
+		return;
+	}
+	this->timer->stop();
+	this->watcher->removePath(this->directory);
+
+	this->stopping.store(true);
+	this->files.close();
+	for(auto it = this->threads.begin(); it != this->threads.end(); ++it) {
+		it->join();
+	}
+	this->threads.clear();
+	this->journal.close();
+}
+
+void WatchFolder::scan() {
+	QDir dir(this->directory);
+	QFileInfoList entries = dir.entryInfoList(QDir::Files, QDir::Time | QDir::Reversed);
+	qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+	std::lock_guard<std::mutex> lock(this->stateMutex);
+	for(auto it = entries.begin(); it != entries.end(); ++it) {
+		QString name = it->fileName();
+		// also skips the temporary files of QSaveFile
+		if(name.startsWith(checkpointName()) || name.contains(RESULT_SUFFIX) || this->inFlight.contains(name)) {
+			continue;
+		}
+		qint64 modified = it->lastModified().toMSecsSinceEpoch();
+		if(now - modified < SETTLE_TIME) {
+			continue;
+		}
+		auto done = this->processed.find(name);
+		if(done != this->processed.end() && *done == FileState(it->size(), modified)) {
+			continue;
+		}
+
+		PendingFile file;
+		file.name = name;
+		file.state = FileState(it->size(), modified);
+		if(!this->files.tryPush(std::move(file))) {
+			// pipeline is saturated, the next scan picks up the rest
+			break;
+		}
+		this->inFlight.insert(name);
+	}
+}
+
+void WatchFolder::readStage() {
+	PendingFile file;
+	while(!this->stopping.load() && this->files.pop(file)) {
+		QFile in(QDir(this->directory).absoluteFilePath(file.name));
+		if(!in.open(QIODevice::ReadOnly)) {
+			ChunkPtr chunk(new Chunk());
+			chunk->file = file;
+			chunk->first = chunk->last = chunk->failed = true;
+			chunk->errors.append(in.errorString());
+			this->readQueue.push(std::move(chunk));
+			continue;
+		}
+
+		int lineNumber = 0;
+		bool first = true;
+		bool last = false;
+		while(!last && !this->stopping.load()) {
+			ChunkPtr chunk(new Chunk());
+			chunk->file = file;
+			chunk->first = first;
+			chunk->firstLine = lineNumber + 1;
+			chunk->lines.reserve(CHUNK_LINES);
+			while(chunk->lines.size() < (size_t)CHUNK_LINES && !in.atEnd()) {
+				chunk->lines.push_back(in.readLine());
+				++lineNumber;
+			}
+			last = in.atEnd();
+			chunk->last = last;
+			first = false;
+			if(!this->readQueue.push(std::move(chunk))) {
+				break;
+			}
+		}
+	}
+	this->readQueue.close();
+}
+
+void WatchFolder::parseStage() {
+	ChunkPtr chunk;
+	while(this->readQueue.pop(chunk)) {
+		std::vector<int> errorLines;
+		for(size_t i = 0; i < chunk->lines.size(); ++i) {
+			QString line = QString::fromUtf8(chunk->lines[i]).trimmed();
+			if(line.isEmpty() || line.startsWith('#')) {
+				continue;
+			}
+			int lineNumber = chunk->firstLine + static_cast<int>(i);
+			try {
+				chunk->samples.push_back(parseBatchLine(line));
+				chunk->sampleLines.push_back(lineNumber);
+			} catch(std::runtime_error &e) {
+				chunk->errors.append(QString("line %1: %2").arg(lineNumber).arg(e.what()));
+				errorLines.push_back(lineNumber);
+			}
+		}
+		chunk->lines.clear();
+
+		std::vector<size_t> failed = resolveDensities(chunk->samples, this->evaluator.getDensityTable());
+		// samples without a density or outside of the range of the evaluator, in sample order
+		std::vector<std::pair<size_t, QString>> rejected;
+		auto density = failed.begin();
+		for(size_t i = 0; i < chunk->samples.size(); ++i) {
+			const BatchSample &sample = chunk->samples[i];
+			if(density != failed.end() && *density == i) {
+				++density;
+				rejected.push_back(std::make_pair(i, QString("No density of \"%1\" at %2%3C in the density table.")
+					.arg(sample.product).arg(sample.temperature).arg(QChar(0xB0))));
+				continue;
+			}
+			const QString rangeError = this->evaluator.checkSample(sample);
+			if(!rangeError.isEmpty()) {
+				rejected.push_back(std::make_pair(i, rangeError));
+			}
+		}
+		if(!rejected.empty()) {
+			// drop the rejected samples in one pass and merge their errors with the parse errors in line order
+			QStringList errors;
+			size_t parseError = 0;
+			size_t kept = 0;
+			auto next = rejected.begin();
+			for(size_t i = 0; i < chunk->samples.size(); ++i) {
+				if(next == rejected.end() || next->first != i) {
+					if(kept != i) {
+						chunk->samples[kept] = std::move(chunk->samples[i]);
+						chunk->sampleLines[kept] = chunk->sampleLines[i];
+					}
+					++kept;
+					continue;
+				}
+				for(; parseError < errorLines.size() && errorLines[parseError] < chunk->sampleLines[i]; ++parseError) {
+					errors.append(chunk->errors.at(static_cast<int>(parseError)));
+				}
+				errors.append(QString("line %1: %2").arg(chunk->sampleLines[i]).arg(next->second));
+				++next;
+			}
+			for(; parseError < errorLines.size(); ++parseError) {
+				errors.append(chunk->errors.at(static_cast<int>(parseError)));
+			}
+			chunk->samples.erase(chunk->samples.begin() + kept, chunk->samples.end());
+			chunk->sampleLines.erase(chunk->sampleLines.begin() + kept, chunk->sampleLines.end());
+			chunk->errors = errors;
+		}
+		this->parseQueue.push(std::move(chunk));
+	}
+	this->parseQueue.close();
+}
+
+void WatchFolder::evaluateStage() {
+	ChunkPtr chunk;
+	while(this->parseQueue.pop(chunk)) {
+		chunk->results.resize(chunk->samples.size());
+		this->evaluator.evaluate(chunk->samples.data(), chunk->samples.size(), chunk->results.data());
+		this->evaluateQueue.push(std::move(chunk));
+	}
+	this->evaluateQueue.close();
+}
+
+void WatchFolder::formatStage() {
+	ChunkPtr chunk;
+	while(this->evaluateQueue.pop(chunk)) {
+		QString text;
+		QTextStream out(&text);
+		if(chunk->first) {
+			out << BatchEvaluator::header();
+		}
+		for(int i = 0; i < chunk->errors.size(); ++i) {
+			out << "# " << chunk->errors.at(i) << "\n";
+		}
+		for(size_t i = 0; i < chunk->samples.size(); ++i) {
+			this->evaluator.format(out, chunk->sampleLines[i], chunk->samples[i], chunk->results[i]);
+		}
+		out.flush();
+		chunk->text = text.toUtf8();
+		chunk->samples.clear();
+		chunk->results.clear();
+		this->formatQueue.push(std::move(chunk));
+	}
+	this->formatQueue.close();
+}
+
+void WatchFolder::writeStage() {
+	ChunkPtr chunk;
+	std::unique_ptr<QSaveFile> out;
+	int samples = 0;
+	int errors = 0;
+	while(this->formatQueue.pop(chunk)) {
+		if(chunk->failed) {
+			// e.g. still locked by the instrument, retried on a later scan until it is given up
+			bool givenUp;
+			{
+				std::lock_guard<std::mutex> lock(this->stateMutex);
+				this->inFlight.remove(chunk->file.name);
+				std::pair<FileState, int> &failures = this->readFailures[chunk->file.name];
+				if(!(failures.first == chunk->file.state)) {
+					failures = std::make_pair(chunk->file.state, 0);
+				}
+				givenUp = ++failures.second >= MAX_READ_ATTEMPTS;
+			}
+			if(givenUp) {
+				this->giveUp(chunk->file, chunk->errors.join("\n"));
+			}
+			continue;
+		}
+		if(chunk->first) {
+			// the full name, a.csv and a.txt must not write to the same result file
+			QString outName = chunk->file.name + RESULT_SUFFIX;
+			out.reset(new QSaveFile(QDir(this->outputDirectory).absoluteFilePath(outName)));
+			samples = 0;
+			errors = 0;
+			if(!out->open(QIODevice::WriteOnly)) {
+				this->giveUp(chunk->file, QString("Cannot write %1.\n%2").arg(outName).arg(out->errorString()));
+				// the remaining chunks of the file are skipped
+				out.reset();
+			}
+		}
+		if(!out) {
+			continue;
+		}
+		out->write(chunk->text);
+		samples += static_cast<int>(chunk->sampleLines.size());
+		errors += chunk->errors.size();
+
+		if(chunk->last) {
+			if(!out->commit()) {
+				this->giveUp(chunk->file, QString("Cannot write the results of %1.\n%2").arg(chunk->file.name).arg(out->errorString()));
+				out.reset();
+				continue;
+			}
+			out.reset();
+
+			{
+				std::lock_guard<std::mutex> lock(this->stateMutex);
+				this->inFlight.remove(chunk->file.name);
+				this->readFailures.remove(chunk->file.name);
+				this->processed.insert(chunk->file.name, chunk->file.state);
+			}
+			this->appendCheckpoint(chunk->file.name, chunk->file.state);
+			emit fileProcessed(chunk->file.name, samples, errors);
+		}
+	}
+	// an incomplete result file is discarded by QSaveFile
+	out.reset();
+}
+
+void WatchFolder::giveUp(const PendingFile &file, const QString &error) {
+	const FileState failedState(file.state.size, file.state.modified, true);
+	{
+		std::lock_guard<std::mutex> lock(this->stateMutex);
+		this->inFlight.remove(file.name);
+		this->readFailures.remove(file.name);
+		this->processed.insert(file.name, failedState);
+	}
+	this->appendCheckpoint(file.name, failedState);
+	emit fileFailed(file.name, error);
+}
+
+void WatchFolder::loadCheckpoint() {
+	const QString path = QDir(this->directory).absoluteFilePath(checkpointName());
+	std::lock_guard<std::mutex> lock(this->stateMutex);
+	QFile file(path);
+	if(file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+		// later lines replace earlier ones of the same file
+		QTextStream in(&file);
+		in.setCodec("UTF-8");
+		while(!in.atEnd()) {
+			QStringList fields = in.readLine().split('\t');
+			if(fields.size() == 3 || fields.size() == 4) {
+				this->processed.insert(fields.at(0), FileState(fields.at(1).toLongLong(), fields.at(2).toLongLong(),
+					fields.size() == 4 && fields.at(3) == "failed"));
+			}
+		}
+		file.close();
+
+		QSaveFile compacted(path);
+		if(compacted.open(QIODevice::WriteOnly | QIODevice::Text)) {
+			QTextStream out(&compacted);
+			out.setCodec("UTF-8");
+			for(auto it = this->processed.begin(); it != this->processed.end(); ++it) {
+				out << it.key() << "\t" << it->size << "\t" << it->modified << (it->failed ? "\tfailed" : "") << "\n";
+			}
+			out.flush();
+			compacted.commit();
+		}
+	}
+
+	this->journal.setFileName(path);
+	this->journal.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text);
+}
+
+void WatchFolder::appendCheckpoint(const QString &name, const FileState &state) {
+	if(!this->journal.isOpen()) {
+		return;
+	}
+	QString line = QString("%1\t%2\t%3%4\n").arg(name).arg(state.size).arg(state.modified).arg(state.failed ? "\tfailed" : "");
+	this->journal.write(line.toUtf8());
+	this->journal.flush();
+}
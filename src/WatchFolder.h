@@ -0,0 +1,124 @@
+#ifndef RLC_WATCH_FOLDER_H
+#define RLC_WATCH_FOLDER_H
+
+#include <QtCore/qobject.h>
+#include <QtCore/qfile.h>
+#include <QtCore/qhash.h>
+#include <QtCore/qset.h>
+#include <QtCore/qstringlist.h>
+#include <QtCore/qfilesystemwatcher.h>
+#include <QtCore/qtimer.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "BatchSample.h"
+#include "BoundedQueue.h"
+
+/** Processes batch files dropped into a directory.
+Every file runs through five stages, each on its own thread:
+read, parse, evaluate, format and write. The stages pass chunks of at most
+CHUNK_LINES lines through bounded queues, so a burst of large files never
+holds more than a few chunks per stage in memory and disk and CPU work overlap.
+Results are written atomically to <output>/<file name>.results.csv. Processed
+files are recorded in a checkpoint journal in the watched directory so they
+are not processed again after a restart: one line is appended per file and
+the journal is compacted on start. A file that cannot be read
+MAX_READ_ATTEMPTS times in a row is recorded as failed and not tried again
+until it changes, as is a file whose results cannot be written.
+*/
+class WatchFolder : public QObject {
+	Q_OBJECT
+public:
+	static const int CHUNK_LINES = 4096;
+	static const size_t QUEUE_CAPACITY = 8;
+	static const int MAX_READ_ATTEMPTS = 10;
+
+	WatchFolder(const QString &directory, const QString &outputDirectory, const BatchEvaluator &evaluator, QObject *parent = 0);
+	virtual ~WatchFolder(void);
+
+	bool start();
+	/** Stop all stages, files not completely written are processed again on the next start */
+	void stop();
+	QString errorString() const {return this->error;}
+
+	static QString checkpointName() {return ".rlc-checkpoint";}
+signals:
+	void fileProcessed(const QString &fileName, int samples, int errors);
+	void fileFailed(const QString &fileName, const QString &error);
+private slots:
+	void scan();
+private:
+	struct FileState {
+		FileState(void) : size(-1), modified(0), failed(false) {}
+		FileState(qint64 size, qint64 modified, bool failed = false) : size(size), modified(modified), failed(failed) {}
+		bool operator==(const FileState &other) const {return this->size == other.size && this->modified == other.modified;}
+		qint64 size;
+		qint64 modified;
+		/** could not be read, see MAX_READ_ATTEMPTS */
+		bool failed;
+	};
+
+	struct PendingFile {
+		QString name;
+		FileState state;
+	};
+
+	struct Chunk {
+		Chunk(void) : first(false), last(false), failed(false), firstLine(0) {}
+		PendingFile file;
+		bool first;
+		bool last;
+		bool failed;
+		int firstLine;
+		std::vector<QByteArray> lines;
+		std::vector<BatchSample> samples;
+		std::vector<int> sampleLines;
+		QStringList errors;
+		std::vector<BatchEvaluator::Result> results;
+		QByteArray text;
+	};
+	typedef std::unique_ptr<Chunk> ChunkPtr;
+
+	void readStage();
+	void parseStage();
+	void evaluateStage();
+	void formatStage();
+	void writeStage();
+
+	/** Read and compact the checkpoint journal and open it for appending */
+	void loadCheckpoint();
+	/** Append one file to the checkpoint journal, only called by the write stage */
+	void appendCheckpoint(const QString &name, const FileState &state);
+	/** Record the file as failed until it changes and emit fileFailed(), only called by the write stage */
+	void giveUp(const PendingFile &file, const QString &error);
+
+	QString directory;
+	QString outputDirectory;
+	BatchEvaluator evaluator;
+	QString error;
+
+	QFileSystemWatcher *watcher;
+	QTimer *timer;
+
+	BoundedQueue<PendingFile> files;
+	BoundedQueue<ChunkPtr> readQueue;
+	BoundedQueue<ChunkPtr> parseQueue;
+	BoundedQueue<ChunkPtr> evaluateQueue;
+	BoundedQueue<ChunkPtr> formatQueue;
+	std::vector<std::thread> threads;
+	std::atomic<bool> stopping;
+
+	QFile journal;
+
+	std::mutex stateMutex;
+	QHash<QString, FileState> processed;
+	QSet<QString> inFlight;
+	/** consecutive read failures of a file in the given state */
+	QHash<QString, std::pair<FileState, int>> readFailures;
+};
+
+#endif //RLC_WATCH_FOLDER_H
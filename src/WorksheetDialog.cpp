@@ -0,0 +1,267 @@
+#include "WorksheetDialog.h"
+
+#include <QtCore/qfile.h>
+#include <QtCore/qrunnable.h>
+#include <QtCore/qsavefile.h>
+#include <QtCore/qtextstream.h>
+#include <QtGui/qclipboard.h>
+#include <QtGui/qkeysequence.h>
+#include <QtWidgets/qapplication.h>
+#include <QtWidgets/qfiledialog.h>
+#include <QtWidgets/qheaderview.h>
+#include <QtWidgets/qmessagebox.h>
+#include <QtWidgets/qshortcut.h>
+#include <algorithm>
+
+/** Evaluates a range of worksheet rows on a pool thread */
+class WorksheetTask : public QRunnable {
+public:
+	WorksheetTask(WorksheetModel *model, const std::shared_ptr<const BatchEvaluator> &evaluator, int first, int last,
+				  std::atomic<bool> *cancelled, std::atomic<int> *finished, std::atomic<int> *evaluated)
+		: model(model), evaluator(evaluator), first(first), last(last),
+		  cancelled(cancelled), finished(finished), evaluated(evaluated) {}
+
+	virtual void run() {
+		int count = 0;
+		if(!this->cancelled->load(std::memory_order_relaxed)) {
+			// evaluate all pending rows of the range in one call
+			std::vector<int> rows;
+			std::vector<BatchSample> samples;
+			for(int row = this->first; row <= this->last; ++row) {
+				if(this->model->getState(row) == WorksheetModel::PENDING) {
+					rows.push_back(row);
+					samples.push_back(this->model->getSample(row));
+				}
+			}
+			std::vector<BatchEvaluator::Result> results(samples.size());
+			this->evaluator->evaluate(samples.data(), samples.size(), results.data());
+			for(size_t i = 0; i < rows.size(); ++i) {
+				this->model->storeResult(rows[i], std::move(results[i]));
+			}
+			count = static_cast<int>(rows.size());
+		}
+		if(count > 0) {
+			this->model->rowsEvaluated(this->first, this->last);
+			this->evaluated->fetch_add(count, std::memory_order_relaxed);
+		}
+		this->finished->fetch_add(this->last - this->first + 1, std::memory_order_release);
+	}
+private:
+	WorksheetModel *model;
+	std::shared_ptr<const BatchEvaluator> evaluator;
+	int first;
+	int last;
+	std::atomic<bool> *cancelled;
+	std::atomic<int> *finished;
+	std::atomic<int> *evaluated;
+};
+
+WorksheetDialog::WorksheetDialog(const EvaluatorFactory &factory, const DensityTable *densities, QWidget *parent)
+	: QDialog(parent), factory(factory), densities(densities), running(false), cancelled(false),
+	  finishedRows(0), evaluatedRows(0), runRows(0) {
+
+	this->model = new WorksheetModel(this);
+
+	this->table = new QTableView();
+	this->table->setModel(this->model);
+	this->table->setSelectionBehavior(QAbstractItemView::SelectRows);
+	this->table->setWordWrap(false);
+	// fixed row heights, the view then never measures rows while scrolling
+	this->table->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+	this->table->verticalHeader()->setDefaultSectionSize(this->table->fontMetrics().height() + 6);
+	this->table->horizontalHeader()->setDefaultSectionSize(90);
+
+	this->btnPaste = new QPushButton("Paste");
+	this->btnImport = new QPushButton("Import...");
+	this->btnExport = new QPushButton("Export...");
+	this->btnClear = new QPushButton("Clear");
+	this->btnEvaluate = new QPushButton("Evaluate");
+	this->btnCancel = new QPushButton("Cancel");
+	this->btnEvaluate->setDefault(true);
+	connect(this->btnPaste, SIGNAL(clicked()), this, SLOT(paste()));
+	connect(this->btnImport, SIGNAL(clicked()), this, SLOT(importFile()));
+	connect(this->btnExport, SIGNAL(clicked()), this, SLOT(exportResults()));
+	connect(this->btnClear, SIGNAL(clicked()), this, SLOT(clear()));
+	connect(this->btnEvaluate, SIGNAL(clicked()), this, SLOT(evaluate()));
+	connect(this->btnCancel, SIGNAL(clicked()), this, SLOT(cancel()));
+	QShortcut *pasteShortcut = new QShortcut(QKeySequence::Paste, this);
+	connect(pasteShortcut, SIGNAL(activated()), this, SLOT(paste()));
+
+	this->buttonLayout = new QHBoxLayout();
+	this->buttonLayout->addWidget(this->btnPaste);
+	this->buttonLayout->addWidget(this->btnImport);
+	this->buttonLayout->addWidget(this->btnExport);
+	this->buttonLayout->addWidget(this->btnClear);
+	this->buttonLayout->addStretch();
+	this->buttonLayout->addWidget(this->btnEvaluate);
+	this->buttonLayout->addWidget(this->btnCancel);
+
+	this->progress = new QProgressBar();
+	this->progress->setRange(0, 1);
+	this->progress->setValue(0);
+	this->status = new QLabel("Paste samples as declared;unit;density;homogeneity;product;temperature, one per line.");
+	this->statusLayout = new QHBoxLayout();
+	this->statusLayout->addWidget(this->status, 1);
+	this->statusLayout->addWidget(this->progress);
+
+	this->mainLayout = new QVBoxLayout();
+	this->mainLayout->addLayout(this->buttonLayout);
+	this->mainLayout->addWidget(this->table);
+	this->mainLayout->addLayout(this->statusLayout);
+	this->setLayout(this->mainLayout);
+
+	connect(&this->updateTimer, SIGNAL(timeout()), this, SLOT(updateProgress()));
+	this->updateTimer.setInterval(UPDATE_INTERVAL);
+
+	this->setWindowTitle("Worksheet");
+	this->resize(800, 500);
+	this->updateButtons();
+}
+
+WorksheetDialog::~WorksheetDialog(void) {
+	this->cancelled.store(true);
+	this->pool.waitForDone();
+}
+
+void WorksheetDialog::paste() {
+	if(this->running) {
+		return;
+	}
+	this->addLines(QApplication::clipboard()->text().split('\n'));
+}
+
+void WorksheetDialog::importFile() {
+	QString path = QFileDialog::getOpenFileName(this, "Import Samples", QString(), "Batch files (*.csv *.txt);;All files (*)");
+	if(path.isEmpty()) {
+		return;
+	}
+	QFile file(path);
+	if(!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+		QMessageBox::critical(this, "Error", QString("Cannot open %1.\n%2").arg(path).arg(file.errorString()));
+		return;
+	}
+	QTextStream in(&file);
+	QStringList lines;
+	while(!in.atEnd()) {
+		lines.append(in.readLine());
+	}
+	this->addLines(lines);
+}
+
+void WorksheetDialog::addLines(const QStringList &lines) {
+	int invalid = this->model->appendLines(lines, this->densities);
+	this->status->setText(invalid == 0 ? QString("%1 samples.").arg(this->model->rowCount())
+		: QString("%1 samples, %2 invalid lines.").arg(this->model->rowCount()).arg(invalid));
+	this->updateButtons();
+}
+
+void WorksheetDialog::exportResults() {
+	const std::shared_ptr<const BatchEvaluator> &evaluator = this->model->getEvaluator();
+	if(!evaluator) {
+		return;
+	}
+	QString path = QFileDialog::getSaveFileName(this, "Export Results", QString(), "Semicolon separated values (*.csv)");
+	if(path.isEmpty()) {
+		return;
+	}
+	QSaveFile file(path);
+	if(!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+		QMessageBox::critical(this, "Error", QString("Cannot write %1.\n%2").arg(path).arg(file.errorString()));
+		return;
+	}
+	{
+		QTextStream out(&file);
+		out << BatchEvaluator::header();
+		for(int row = 0; row < this->model->rowCount(); ++row) {
+			if(this->model->getState(row) == WorksheetModel::DONE) {
+				evaluator->format(out, row + 1, this->model->getSample(row), this->model->getResult(row));
+			}
+		}
+	}
+	if(!file.commit()) {
+		QMessageBox::critical(this, "Error", QString("Cannot write %1.\n%2").arg(path).arg(file.errorString()));
+	}
+}
+
+void WorksheetDialog::evaluate() {
+	if(this->running || this->model->rowCount() == 0) {
+		return;
+	}
+	// the visible rules or the settings may have changed since the last run
+	this->model->setEvaluator(this->factory());
+	const std::shared_ptr<const BatchEvaluator> &evaluator = this->model->getEvaluator();
+
+	this->runRows = this->model->rowCount();
+	this->cancelled.store(false);
+	this->finishedRows.store(0);
+	this->evaluatedRows.store(0);
+	this->running = true;
+
+	for(int first = 0; first < this->runRows; first += CHUNK_ROWS) {
+		int last = std::min(first + CHUNK_ROWS, this->runRows) - 1;
+		this->pool.start(new WorksheetTask(this->model, evaluator, first, last,
+			&this->cancelled, &this->finishedRows, &this->evaluatedRows));
+	}
+
+	this->progress->setRange(0, this->runRows);
+	this->progress->setValue(0);
+	this->status->setText("Evaluating...");
+	this->updateButtons();
+	this->updateTimer.start();
+}
+
+void WorksheetDialog::cancel() {
+	if(this->running) {
+		this->cancelled.store(true);
+		this->status->setText("Cancelling...");
+	}
+}
+
+void WorksheetDialog::clear() {
+	if(this->running) {
+		return;
+	}
+	this->model->clear();
+	this->progress->setRange(0, 1);
+	this->progress->setValue(0);
+	this->status->setText(QString());
+	this->updateButtons();
+}
+
+void WorksheetDialog::reject() {
+	// the samples are kept, the worksheet can be reopened
+	this->cancel();
+	QDialog::reject();
+}
+
+void WorksheetDialog::updateProgress() {
+	this->model->publish();
+	this->progress->setValue(this->finishedRows.load(std::memory_order_relaxed));
+	if(this->finishedRows.load(std::memory_order_acquire) >= this->runRows) {
+		this->finishRun();
+	}
+}
+
+void WorksheetDialog::finishRun() {
+	this->updateTimer.stop();
+	this->pool.waitForDone();
+	this->model->publish();
+	this->running = false;
+
+	int evaluated = this->evaluatedRows.load();
+	this->progress->setValue(this->finishedRows.load());
+	this->status->setText(this->cancelled.load()
+		? QString("Cancelled, %1 of %2 samples evaluated.").arg(evaluated).arg(this->runRows)
+		: QString("%1 samples evaluated.").arg(evaluated));
+	this->updateButtons();
+}
+
+void WorksheetDialog::updateButtons() {
+	bool hasRows = this->model->rowCount() > 0;
+	this->btnPaste->setEnabled(!this->running);
+	this->btnImport->setEnabled(!this->running);
+	this->btnClear->setEnabled(!this->running && hasRows);
+	this->btnExport->setEnabled(!this->running && this->model->getEvaluator() != nullptr);
+	this->btnEvaluate->setEnabled(!this->running && hasRows);
+	this->btnCancel->setEnabled(this->running);
+}
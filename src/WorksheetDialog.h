@@ -0,0 +1,80 @@
+#ifndef RLC_WORKSHEET_DIALOG_H
+#define RLC_WORKSHEET_DIALOG_H
+
+#include <QtWidgets/qdialog.h>
+#include <QtWidgets/qboxlayout.h>
+#include <QtWidgets/qlabel.h>
+#include <QtWidgets/qprogressbar.h>
+#include <QtWidgets/qpushbutton.h>
+#include <QtWidgets/qtableview.h>
+#include <QtCore/qthreadpool.h>
+#include <QtCore/qtimer.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include "WorksheetModel.h"
+
+/** Evaluates many samples at once.
+Samples are pasted from the clipboard (e.g. cells copied from a spreadsheet)
+or imported from a batch file and evaluated against all visible rules on a
+thread pool. Each task evaluates CHUNK_ROWS rows; the rows finished so far
+are shown every UPDATE_INTERVAL milliseconds, so the table stays responsive
+while the evaluation runs.
+*/
+class WorksheetDialog : public QDialog {
+	Q_OBJECT
+public:
+	/** Creates the evaluator for a run, called on the GUI thread when evaluation starts */
+	typedef std::function<std::shared_ptr<const BatchEvaluator>()> EvaluatorFactory;
+
+	static const int CHUNK_ROWS = 32;
+	static const int UPDATE_INTERVAL = 100;
+
+	WorksheetDialog(const EvaluatorFactory &factory, const DensityTable *densities, QWidget *parent = 0);
+	virtual ~WorksheetDialog(void);
+
+	bool isRunning() const {return this->running;}
+public slots:
+	void paste();
+	void importFile();
+	void exportResults();
+	void evaluate();
+	void cancel();
+	void clear();
+	virtual void reject();
+private slots:
+	void updateProgress();
+private:
+	void addLines(const QStringList &lines);
+	void finishRun();
+	void updateButtons();
+
+	EvaluatorFactory factory;
+	const DensityTable *densities;
+	WorksheetModel *model;
+
+	QVBoxLayout *mainLayout;
+	QHBoxLayout *buttonLayout;
+	QHBoxLayout *statusLayout;
+	QTableView *table;
+	QPushButton *btnPaste;
+	QPushButton *btnImport;
+	QPushButton *btnExport;
+	QPushButton *btnClear;
+	QPushButton *btnEvaluate;
+	QPushButton *btnCancel;
+	QProgressBar *progress;
+	QLabel *status;
+
+	QThreadPool pool;
+	QTimer updateTimer;
+	bool running;
+	std::atomic<bool> cancelled;
+	std::atomic<int> finishedRows;
+	std::atomic<int> evaluatedRows;
+	int runRows;
+};
+
+#endif //RLC_WORKSHEET_DIALOG_H
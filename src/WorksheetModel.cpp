@@ -0,0 +1,214 @@
+#include "WorksheetModel.h"
+
+#include <QtGui/qbrush.h>
+#include <stdexcept>
+
+static const char* INPUT_TITLES[WorksheetModel::INPUT_COLUMNS] = {
+	"Declared", "Unit", "Density", "Homogeneity", "Product", "Temperature", "Status"
+};
+
+WorksheetModel::WorksheetModel(QObject *parent)
+	: QAbstractTableModel(parent) {
+}
+
+WorksheetModel::~WorksheetModel(void) {
+}
+
+int WorksheetModel::rowCount(const QModelIndex &parent) const {
+	return parent.isValid() ? 0 : static_cast<int>(this->samples.size());
+}
+
+int WorksheetModel::columnCount(const QModelIndex &parent) const {
+	return parent.isValid() ? 0 : INPUT_COLUMNS + static_cast<int>(this->outputColumns.size());
+}
+
+QVariant WorksheetModel::data(const QModelIndex &index, int role) const {
+	if(!index.isValid() || index.row() >= this->rowCount()) {
+		return QVariant();
+	}
+	const int row = index.row();
+	const int column = index.column();
+	const RowState state = this->getState(row);
+
+	if(role == Qt::TextAlignmentRole) {
+		return column == 1 || column == 3 || column == 4 || column == 6
+			? int(Qt::AlignLeft | Qt::AlignVCenter) : int(Qt::AlignRight | Qt::AlignVCenter);
+	}
+	if(role == Qt::ForegroundRole && state == INVALID) {
+		return QBrush(Qt::red);
+	}
+	if(role == Qt::ToolTipRole && state == INVALID) {
+		return this->rowError(row);
+	}
+	if(role != Qt::DisplayRole) {
+		return QVariant();
+	}
+
+	const BatchSample &sample = this->samples[row];
+	if(state == INVALID && column < INPUT_COLUMNS - 1) {
+		return column == 0 ? this->lines[row] : QVariant();
+	}
+	switch(column) {
+	case 0:
+		return QString::number(sample.declared.getValue());
+	case 1:
+		return sample.declared.getUnit() == Unit::g_per_l ? "g/l" : "% w/w";
+	case 2:
+		return QString::number(sample.density, 'f', 4);
+	case 3:
+		return sample.homogenous ? "homogenous" : "heterogenous";
+	case 4:
+		return sample.product;
+	case 5:
+		return sample.product.isEmpty() ? QVariant() : QVariant(QString::number(sample.temperature));
+	case 6:
+		return state == INVALID ? this->rowError(row) : state == DONE ? "OK" : QString();
+	}
+
+	if(state != DONE) {
+		return QVariant();
+	}
+	const OutputColumn &output = this->outputColumns[column - INPUT_COLUMNS];
+	const BatchEvaluator::Result &result = this->results[row];
+	if(output.rule >= this->evaluator->ruleCount() || output.output >= (int)this->evaluator->outputCount(output.rule)
+	   || this->evaluator->outputOffset(output.rule) + output.output >= result.size()) {
+		return QVariant();
+	}
+	return this->evaluator->formatValue(result[this->evaluator->outputOffset(output.rule) + output.output], output.unit, sample.density);
+}
+
+QVariant WorksheetModel::headerData(int section, Qt::Orientation orientation, int role) const {
+	if(role != Qt::DisplayRole) {
+		return QVariant();
+	}
+	if(orientation == Qt::Vertical) {
+		return section + 1;
+	}
+	if(section < INPUT_COLUMNS) {
+		return INPUT_TITLES[section];
+	}
+	const OutputColumn &output = this->outputColumns[section - INPUT_COLUMNS];
+	return QString("%1\n%2 [%3]").arg(this->evaluator->getRuleName(output.rule))
+		.arg(this->evaluator->getOutputTitles(output.rule).at(output.output))
+		.arg(output.unit == Unit::g_per_l ? "g/l" : "% w/w");
+}
+
+int WorksheetModel::appendLines(const QStringList &lines, const DensityTable *densities) {
+	std::vector<BatchSample> samples;
+	std::vector<QString> raw;
+	std::vector<QString> errors;
+	for(auto it = lines.begin(); it != lines.end(); ++it) {
+		QString line = it->trimmed();
+		if(line.isEmpty() || line.startsWith('#')) {
+			continue;
+		}
+		raw.push_back(line);
+		try {
+			samples.push_back(parseBatchLine(line));
+			errors.push_back(QString());
+		} catch(std::runtime_error &e) {
+			samples.push_back(BatchSample());
+			errors.push_back(e.what());
+		}
+	}
+
+	std::vector<size_t> failed = resolveDensities(samples, densities);
+	for(auto it = failed.begin(); it != failed.end(); ++it) {
+		if(errors[*it].isEmpty()) {
+			errors[*it] = QString("The density table has no density of %1 at %2%3C.")
+				.arg(samples[*it].product).arg(samples[*it].temperature).arg(QChar(0xB0));
+		}
+	}
+	if(samples.empty()) {
+		return 0;
+	}
+
+	const int first = this->rowCount();
+	this->beginInsertRows(QModelIndex(), first, first + static_cast<int>(samples.size()) - 1);
+	this->samples.insert(this->samples.end(), samples.begin(), samples.end());
+	this->lines.insert(this->lines.end(), raw.begin(), raw.end());
+	this->errors.insert(this->errors.end(), errors.begin(), errors.end());
+	this->resetStates(first);
+	this->endInsertRows();
+
+	int invalid = 0;
+	for(size_t i = first; i < this->samples.size(); ++i) {
+		if(!this->rowError(i).isEmpty()) ++invalid;
+	}
+	return invalid;
+}
+
+void WorksheetModel::clear() {
+	this->beginResetModel();
+	this->samples.clear();
+	this->lines.clear();
+	this->errors.clear();
+	this->resetStates();
+	this->endResetModel();
+}
+
+void WorksheetModel::setEvaluator(const std::shared_ptr<const BatchEvaluator> &evaluator) {
+	this->beginResetModel();
+	this->evaluator = evaluator;
+	this->outputColumns.clear();
+	if(evaluator) {
+		for(size_t r = 0; r < evaluator->ruleCount(); ++r) {
+			for(int i = 0; i < evaluator->getOutputTitles(r).size(); ++i) {
+				OutputColumn gl = {r, i, Unit::g_per_l};
+				OutputColumn ww = {r, i, Unit::PERCENT_WW};
+				this->outputColumns.push_back(gl);
+				this->outputColumns.push_back(ww);
+			}
+		}
+	}
+	this->resetStates();
+	this->endResetModel();
+}
+
+void WorksheetModel::resetStates(size_t keep) {
+	const size_t count = this->samples.size();
+	this->results.resize(keep);
+	this->results.resize(count);
+	std::unique_ptr<std::atomic<quint8>[]> states(new std::atomic<quint8>[count]);
+	for(size_t i = 0; i < keep; ++i) {
+		states[i].store(this->states[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+	this->states.swap(states);
+	this->rangeErrors.resize(keep);
+	this->rangeErrors.resize(count);
+	for(size_t i = keep; i < count; ++i) {
+		if(this->errors[i].isEmpty() && this->evaluator) {
+			this->rangeErrors[i] = this->evaluator->checkSample(this->samples[i]);
+		}
+		this->states[i].store(this->rowError(i).isEmpty() ? PENDING : INVALID, std::memory_order_relaxed);
+	}
+	std::lock_guard<std::mutex> lock(this->evaluatedMutex);
+	this->evaluated.clear();
+}
+
+const QString& WorksheetModel::rowError(size_t row) const {
+	return this->errors[row].isEmpty() ? this->rangeErrors[row] : this->errors[row];
+}
+
+void WorksheetModel::storeResult(int row, BatchEvaluator::Result &&result) {
+	this->results[row] = std::move(result);
+	// publishes the result to data() on the GUI thread
+	this->states[row].store(DONE, std::memory_order_release);
+}
+
+void WorksheetModel::rowsEvaluated(int first, int last) {
+	std::lock_guard<std::mutex> lock(this->evaluatedMutex);
+	this->evaluated.push_back(std::make_pair(first, last));
+}
+
+void WorksheetModel::publish() {
+	std::vector<std::pair<int, int>> ranges;
+	{
+		std::lock_guard<std::mutex> lock(this->evaluatedMutex);
+		ranges.swap(this->evaluated);
+	}
+	const int lastColumn = this->columnCount() - 1;
+	for(auto it = ranges.begin(); it != ranges.end(); ++it) {
+		emit this->dataChanged(this->index(it->first, INPUT_COLUMNS - 1), this->index(it->second, lastColumn));
+	}
+}
@@ -0,0 +1,91 @@
+#ifndef RLC_WORKSHEET_MODEL_H
+#define RLC_WORKSHEET_MODEL_H
+
+#include <QtCore/qabstractitemmodel.h>
+#include <QtCore/qstringlist.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "BatchSample.h"
+
+/** Samples of the worksheet and their results.
+The input columns (declared value, unit, density, homogeneity, product,
+temperature and status) are followed by two columns (g/l and % w/w) per
+output of every rule of the evaluator.
+
+While an evaluation runs the samples must not be changed. Worker threads
+store results with storeResult(); each row is published to the GUI thread
+by an atomic state, so data() never blocks on a worker. The rows evaluated
+so far are announced in batches by publish(), which the GUI calls on a timer.
+*/
+class WorksheetModel : public QAbstractTableModel {
+	Q_OBJECT
+public:
+	enum RowState {
+		PENDING = 0,
+		DONE = 1,
+		INVALID = 2		///< the line could not be parsed or the density is not in the table
+	};
+	static const int INPUT_COLUMNS = 7;
+
+	explicit WorksheetModel(QObject *parent = 0);
+	virtual ~WorksheetModel(void);
+
+	virtual int rowCount(const QModelIndex &parent = QModelIndex()) const;
+	virtual int columnCount(const QModelIndex &parent = QModelIndex()) const;
+	virtual QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+	virtual QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+
+	/** Parse the lines in batch file format and append them as samples.
+	Lines that cannot be parsed are kept as invalid rows with the error message.
+	\return number of invalid rows added
+	*/
+	int appendLines(const QStringList &lines, const DensityTable *densities);
+	void clear();
+
+	/** Discard all results and take the result columns from the evaluator */
+	void setEvaluator(const std::shared_ptr<const BatchEvaluator> &evaluator);
+	const std::shared_ptr<const BatchEvaluator>& getEvaluator() const {return this->evaluator;}
+
+	const BatchSample& getSample(int row) const {return this->samples[row];}
+	RowState getState(int row) const {return static_cast<RowState>(this->states[row].load(std::memory_order_acquire));}
+	const BatchEvaluator::Result& getResult(int row) const {return this->results[row];}
+
+	/** Store the result of one row. May be called from any thread. */
+	void storeResult(int row, BatchEvaluator::Result &&result);
+	/** Announce rows [first, last] as evaluated. May be called from any thread. */
+	void rowsEvaluated(int first, int last);
+	/** Emit dataChanged() for all rows announced since the last call. GUI thread only. */
+	void publish();
+private:
+	struct OutputColumn {
+		size_t rule;
+		int output;
+		Unit unit;
+	};
+
+	/** Discard results and states of all rows but the first keep ones */
+	void resetStates(size_t keep = 0);
+	/** Why the row is INVALID, empty if it is not */
+	const QString& rowError(size_t row) const;
+
+	std::vector<BatchSample> samples;
+	std::vector<QString> lines;
+	std::vector<QString> errors;
+	/** rows the current evaluator cannot evaluate, see BatchEvaluator::checkSample() */
+	std::vector<QString> rangeErrors;
+	std::vector<BatchEvaluator::Result> results;
+	std::unique_ptr<std::atomic<quint8>[]> states;
+
+	std::shared_ptr<const BatchEvaluator> evaluator;
+	std::vector<OutputColumn> outputColumns;
+
+	std::mutex evaluatedMutex;
+	std::vector<std::pair<int, int>> evaluated;
+};
+
+#endif //RLC_WORKSHEET_MODEL_H
@@ -1,12 +1,297 @@
 #include "mainwindow.h"
+#include "AuditLog.h"
+#include "DensityTable.h"
+#include "RuleCatalog.h"
+#include "InstanceServer.h"
+#include "WatchFolder.h"
+#include "Verification.h"
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QDesktopWidget.h>
+#include <QtCore/qdir.h>
+#include <QtCore/qsettings.h>
+#include <QtCore/qstandardpaths.h>
+#include <cstdio>
+
+/** Convert an audit log into semicolon separated values
+\param args the arguments following --export-audit: the log file and optionally the output file
+*/
+static int exportAudit(const QStringList &args) {
+	QTextStream err(stderr);
+	if(args.isEmpty()) {
+		err << "Usage: ReleaseLimitsCalculator --export-audit <log> [<csv>]\n";
+		return 2;
+	}
+
+	AuditLogReader reader;
+	if(!reader.read(args.at(0))) {
+		err << reader.errorString() << "\n";
+		return 1;
+	}
+
+	QFile outFile;
+	if(args.size() > 1) {
+		outFile.setFileName(args.at(1));
+		if(!outFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
+			err << "Cannot write " << args.at(1) << ".\n" << outFile.errorString() << "\n";
+			return 1;
+		}
+	} else {
+		outFile.open(stdout, QIODevice::WriteOnly | QIODevice::Text);
+	}
+	QTextStream out(&outFile);
+	reader.exportCsv(out);
+	out.flush();
+
+	err << reader.getRecords().size() << " records exported, "
+		<< reader.getDroppedRecords() << " records dropped, "
+		<< reader.getCorruptBlocks() << " corrupt blocks.\n";
+	return reader.getCorruptBlocks() == 0 ? 0 : 1;
+}
+
+/** Compare the optimized evaluation paths against the reference and measure their throughput
+\param args the arguments following --verify
+*/
+static int verify(const QStringList &args) {
+	QTextStream out(stdout);
+	Verification::Options options;
+	bool ok = true;
+	for(int i = 0; i < args.size() && ok; ++i) {
+		const QString &arg = args.at(i);
+		bool hasValue = i + 1 < args.size();
+		if(arg == "--seed" && hasValue) {
+			options.seed = args.at(++i).toULongLong(&ok);
+		} else if(arg == "--rule-sets" && hasValue) {
+			options.ruleSets = args.at(++i).toInt(&ok);
+			ok = ok && options.ruleSets > 0;
+		} else if(arg == "--samples" && hasValue) {
+			options.samples = args.at(++i).toInt(&ok);
+			ok = ok && options.samples >= 0;
+		} else if(arg == "--baseline" && hasValue) {
+			options.baseline = args.at(++i);
+		} else if(arg == "--update-baseline") {
+			options.updateBaseline = true;
+		} else if(arg == "--threshold" && hasValue) {
+			options.threshold = args.at(++i).toDouble(&ok) / 100.;
+			ok = ok && options.threshold >= 0;
+		} else {
+			ok = false;
+		}
+	}
+	if(!ok) {
+		QTextStream(stderr) << "Usage: ReleaseLimitsCalculator --verify [--seed <n>] [--rule-sets <n>] [--samples <n>]"
+			" [--baseline <file> [--update-baseline] [--threshold <percent>]]\n";
+		return 2;
+	}
+	return Verification(options, out).run();
+}
+
+/** Try to hand the invocation over to an already running instance.
+Relative batch file names are resolved here, the running instance may have another working directory.
+\return true if a running instance took the arguments, also if it did not reply in time
+*/
+static bool forwardToInstance(QStringList args, bool isCommand, int &exitCode) {
+	if(!isCommand) {
+		args = QStringList("--show");
+	}
+	for(int i = 0; i + 1 < args.size(); ++i) {
+		if(args.at(i) == "--batch" || args.at(i) == "--targets") {
+			args[i + 1] = QDir::current().absoluteFilePath(args.at(i + 1));
+		}
+	}
+
+	QString output;
+	switch(InstanceServer::forward(args, output, exitCode)) {
+	case InstanceServer::ForwardResult::NO_INSTANCE:
+		return false;
+	case InstanceServer::ForwardResult::NO_REPLY:
+		// running it here as well would calculate and audit the samples twice
+		QTextStream(stderr) << "The running instance took the command but did not reply within "
+			<< InstanceServer::REPLY_TIMEOUT / 1000 << " seconds, it may still be running there.\n";
+		exitCode = 1;
+		return true;
+	case InstanceServer::ForwardResult::REPLIED:
+		break;
+	}
+	QTextStream(exitCode == 0 ? stdout : stderr) << output;
+	return true;
+}
+
+/** Run as watch-folder daemon until the process is terminated.
+Needs no GUI: the rules are compiled without widgets and the settings, the
+audit log and the density table are read like the window does.
+\param args the arguments without the program name
+*/
+static int watchFolder(const QStringList &args) {
+	QTextStream err(stderr);
+	QString directory, outputDirectory;
+	QStringList ruleNames;
+	bool exact = false;
+	for(int i = 0; i < args.size(); ++i) {
+		if(args.at(i) == "--watch" && i + 1 < args.size()) {
+			directory = args.at(++i);
+		} else if(args.at(i) == "--output" && i + 1 < args.size()) {
+			outputDirectory = args.at(++i);
+		} else if(args.at(i) == "--rule" && i + 1 < args.size()) {
+			ruleNames.append(args.at(++i));
+		} else if(args.at(i) == "--exact") {
+			exact = true;
+		}
+	}
+	if(directory.isEmpty()) {
+		err << "Usage: ReleaseLimitsCalculator --watch <directory> [--output <directory>] [--rule <name>]... [--exact]\n";
+		return 2;
+	}
+	if(outputDirectory.isEmpty()) {
+		outputDirectory = QDir(directory).absoluteFilePath("results");
+	}
+
+	QSettings settings(QSettings::IniFormat, QSettings::UserScope, "Cody-Films", "ReleaseLimitsCalculator");
+	bool ok;
+	unsigned int precision = settings.value("precision", 2).toUInt(&ok);
+	if(!ok) {
+		precision = 2;
+	}
+
+	RuleCatalog catalog;
+	QStringList warnings;
+	if(!catalog.openDirectory("rules", warnings)) {
+		if(!QFile::exists("rules.json")) {
+			err << "The configuration file rules.json was not found.\n";
+			return 1;
+		}
+		catalog.openFile("rules.json");
+	}
+	QStringList hidden = settings.value("hidden", "").toString().split(",");
+	QStringList names = ruleNames;
+	if(names.isEmpty()) {
+		// all visible rules; a single rule file has no index, its hidden rules are dropped after compiling
+		QStringList all = catalog.names();
+		for(auto it = all.begin(); it != all.end(); ++it) {
+			if(!hidden.contains(*it)) {
+				names.append(*it);
+			}
+		}
+	}
+	std::vector<CompiledRule> rules = catalog.compile(names, warnings);
+	for(auto it = warnings.begin(); it != warnings.end(); ++it) {
+		err << *it << "\n";
+	}
+	QStringList missing = ruleNames;
+	for(auto it = rules.begin(); it != rules.end();) {
+		missing.removeAll(it->name);
+		it = ruleNames.isEmpty() && hidden.contains(it->name) ? rules.erase(it) : it + 1;
+	}
+	if(!missing.isEmpty()) {
+		err << "The rules " << missing.join(", ") << " could not be loaded.\n";
+		return 1;
+	}
+
+	AuditLog auditLog;
+	QString defaultPath = QStandardPaths::writableLocation(QStandardPaths::DataLocation) + "/audit.rlclog";
+	if(!auditLog.open(settings.value("auditLog", defaultPath).toString())) {
+		err << "Calculations will not be recorded.\n" << auditLog.errorString() << "\n";
+	}
+	auditLog.setRuleSetHash(catalog.getHash());
+
+	DensityTable densityTable;
+	QStringList densityWarnings;
+	densityTable.load("densities.json", densityWarnings);
+	if(!densityWarnings.isEmpty()) {
+		err << "The density table densities.json has errors.\n" << densityWarnings.join("\n") << "\n";
+	}
+
+	WatchFolder watch(directory, outputDirectory,
+		BatchEvaluator(rules, precision, &auditLog, AuditSource::WATCH, exact, &densityTable));
+	bool auditFailureReported = false;
+	QObject::connect(&watch, &WatchFolder::fileProcessed, [&auditLog, &auditFailureReported](const QString &fileName, int samples, int errors) {
+		QTextStream(stdout) << fileName << ": " << samples << " samples, " << errors << " errors\n";
+		if(!auditFailureReported && !auditLog.flush()) {
+			auditFailureReported = true;
+			QTextStream(stderr) << "Calculations are no longer recorded completely.\n" << auditLog.errorString() << "\n";
+		}
+	});
+	QObject::connect(&watch, &WatchFolder::fileFailed, [](const QString &fileName, const QString &error) {
+		QTextStream(stderr) << fileName << ": given up, " << error << "\n";
+	});
+	if(!watch.start()) {
+		err << watch.errorString() << "\n";
+		return 1;
+	}
+	err << "Watching " << QDir(directory).absolutePath() << ", results in " << QDir(outputDirectory).absolutePath() << "\n";
+	err.flush();
+	return qApp->exec();
+}
 
 int main(int argc, char *argv[])
 {
+	bool isCommand, serve, singleInstance;
+	bool verifying;
+	QStringList verifyArgs;
+	{
+		// forwarding, exporting and the watch folder do not need the GUI, keep the start-up cheap
+		QCoreApplication core(argc, argv);
+		QStringList args = core.arguments();
+		int exportIndex = args.indexOf("--export-audit");
+		if(exportIndex >= 0) {
+			return exportAudit(args.mid(exportIndex + 1));
+		}
+		int verifyIndex = args.indexOf("--verify");
+		verifying = verifyIndex >= 0;
+		if(verifying) {
+			// the rules under test are widgets, they need the QApplication created below
+			verifyArgs = args.mid(verifyIndex + 1);
+		} else {
+			if(args.contains("--watch")) {
+				core.setOrganizationName("Cody-Films");
+				core.setApplicationName("ReleaseLimitsCalculator");
+				return watchFolder(args.mid(1));
+			}
+
+			isCommand = args.contains("--calc") || args.contains("--batch") || args.contains("--inverse") || args.contains("--targets");
+			serve = args.contains("--serve");
+			QSettings settings(QSettings::IniFormat, QSettings::UserScope, "Cody-Films", "ReleaseLimitsCalculator");
+			singleInstance = settings.value("singleInstance", true).toBool();
+
+			int exitCode;
+			if((singleInstance || isCommand) && !serve && forwardToInstance(args.mid(1), isCommand, exitCode)) {
+				return exitCode;
+			}
+		}
+	}
+
+	if(verifying) {
+		// the widgets are never shown, no display is needed
+		if(qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+			qputenv("QT_QPA_PLATFORM", "offscreen");
+		}
+		QApplication app(argc, argv);
+		return verify(verifyArgs);
+	}
+
     QApplication a(argc, argv);
+	a.setOrganizationName("Cody-Films");
+	a.setApplicationName("ReleaseLimitsCalculator");
+
     MainWindow w;
 
+	if(isCommand) {
+		// no running instance: calculate in this process
+		QString output;
+		int exitCode = w.runCommand(a.arguments().mid(1), output);
+		QTextStream(exitCode == 0 ? stdout : stderr) << output;
+		return exitCode;
+	}
+
+	InstanceServer server([&w](const QStringList &args) {
+		return w.prepareCommand(args);
+	});
+	if(singleInstance || serve) {
+		server.listen();
+	}
+	if(serve) {
+		return a.exec();
+	}
+
 	QRect screenGeometry = QApplication::desktop()->screenGeometry();
 	int x = (screenGeometry.width()-w.width()) / 2;
 	//int y = (screenGeometry.height()-w.height()) / 2;
@@ -2,18 +2,27 @@
 #include "ui_mainwindow.h"
 
 #include <exception>
+#include <stdexcept>
 #include <QMessageBox>
 #include <QSpacerItem>
-#include <qjsondocument.h>
-#include <qjsonarray.h>
 #include <qjsonobject.h>
 #include <qjsonvalue.h>
 #include <qfile.h>
+#include <qstandardpaths.h>
+#include <qtextstream.h>
+#include <qtimer.h>
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow),
-	settingsDialog(nullptr)
+	settingsDialog(nullptr),
+	worksheetDialog(nullptr),
+	catalog(nullptr),
+	auditLog(new AuditLog()),
+	densityTable(new DensityTable()),
+	densityTyped(false),
+	auditFailureShown(false),
+	precision(2)
 {
 	this->settings = new QSettings(QSettings::IniFormat, QSettings::UserScope, "Cody-Films", "ReleaseLimitsCalculator");
 
@@ -26,46 +35,19 @@ MainWindow::MainWindow(QWidget *parent) :
 
 	this->rules = new RuleVector();
 
-	ReleaseLimitsRuleBuilder ruleBuilder;
-
-	//load rules from file
-	QFile *ruleFile = new QFile("rules.json");
-	if(!ruleFile->open(QIODevice::ReadOnly)) {
-		QMessageBox::critical(this, "Error", "The configuration file rules.json was not found.");
-		qApp->quit();
-	}
-	QJsonParseError jerr;
-	QJsonDocument rulesJsonDoc = QJsonDocument::fromJson(ruleFile->readAll(), &jerr);
-	ruleFile->close();
-	delete ruleFile;
-	if(jerr.error != QJsonParseError::NoError) {
-		QMessageBox::critical(this, "Error",
-			QString("Error while parising the configuration file rules.json.\n%1").arg(jerr.errorString()));
-		qApp->quit();
-	}
-	if(!rulesJsonDoc.isArray()) {
-		QMessageBox::critical(this, "Error",
-			"Error while parising the configuration file rules.json.\nTop level element is not an array.");
-		qApp->quit();
-	}
-	QJsonArray arr = rulesJsonDoc.array();
-	for(auto it = arr.begin(); it != arr.end(); ++it) {
-		if(!(*it).isObject()) {
-			QMessageBox::warning(this, "Erroneous Configuration",
-				QString("The configuration file rules.json has errors.\n"
-				"Skipping rule #%1.\nArray element is not an object.").arg(it - arr.begin()));
-			break;
-		}
-		try {
-			this->rules->push_back(ruleBuilder.createFromJson((*it).toObject()));
-		} catch (ReleaseLimitsRuleBuilder::json_error &e) {
-			QMessageBox::warning(this, "Erroneous Configuration",
-				QString("The configuration file rules.json has errors.\n"
-				"Skipping rule #%1.\n%2").arg(it - arr.begin()).arg(e.qwhat()));
-			ruleBuilder.reset();
+	//load rules from the rules directory, or from one file if there is none
+	this->catalog = new RuleCatalog();
+	{
+		QStringList warnings;
+		if(!this->catalog->openDirectory("rules", warnings)) {
+			if(!QFile::exists("rules.json")) {
+				QMessageBox::critical(this, "Error", "The configuration file rules.json was not found.");
+				qApp->quit();
+			}
+			this->catalog->openFile("rules.json");
 		}
+		this->showRuleWarnings(warnings);
 	}
-
 	{
 		bool ok;
 		unsigned int precision = this->settings->value("precision", 2).toUInt(&ok);
@@ -73,23 +55,69 @@ MainWindow::MainWindow(QWidget *parent) :
 			precision = 2;
 			this->settings->setValue("precision", 2);
 		}
+		this->precision = precision;
 		for(auto it = this->rules->begin(); it != this->rules->end(); ++it) {
 			(*it)->updatePrecision(precision);
 		}
 	}
 
+	{
+		QString defaultPath = QStandardPaths::writableLocation(QStandardPaths::DataLocation) + "/audit.rlclog";
+		QString auditPath = this->settings->value("auditLog", defaultPath).toString();
+		if(!this->auditLog->open(auditPath)) {
+			QMessageBox::warning(this, "Audit Trail",
+				QString("Calculations will not be recorded.\n%1").arg(this->auditLog->errorString()));
+		}
+		// the log is written in the background, the window, the worksheet and forwarded commands all feed it
+		QTimer *auditTimer = new QTimer(this);
+		QObject::connect(auditTimer, SIGNAL(timeout()), this, SLOT(checkAuditLog()));
+		auditTimer->start(AUDIT_CHECK_MSECS);
+	}
+
+	{
+		// the density table is optional
+		QStringList warnings;
+		this->densityTable->load("densities.json", warnings);
+		if(!warnings.isEmpty()) {
+			QMessageBox::warning(this, "Erroneous Density Table",
+				QString("The density table densities.json has errors.\n%1").arg(warnings.join("\n")));
+		}
+		this->ui->cbProduct->addItem("(enter density manually)");
+		this->ui->cbProduct->addItems(this->densityTable->products());
+		this->ui->cbProduct->setEnabled(!this->densityTable->isEmpty());
+		this->ui->editTemperature->setEnabled(!this->densityTable->isEmpty());
+	}
+
 	QStringList hidden = this->settings->value("hidden", "").toString().split(",");
+	this->showRuleWarnings(this->loadRules(this->visibleRules(hidden)));
 	this->displayRules(hidden);
 
 	QObject::connect(this->ui->btnCalculate, SIGNAL(clicked()), this, SLOT(calculateReleaseLimits()));
 	QObject::connect(this->ui->btnClear, SIGNAL(clicked()), this, SLOT(clearAll()));
+	// textEdited() is not emitted for setText(), so the default of the form and filled in densities do not count as typed
+	QObject::connect(this->ui->editDensity, SIGNAL(textEdited(QString)), this, SLOT(densityEdited()));
 	
 	QObject::connect(this->ui->actionSettings, SIGNAL(triggered()), this, SLOT(displaySettings()));
+	QObject::connect(this->ui->actionWorksheet, SIGNAL(triggered()), this, SLOT(displayWorksheet()));
 	QObject::connect(this->ui->actionQuit, SIGNAL(triggered()), qApp, SLOT(quit()));
 	QObject::connect(this->ui->actionInfo, SIGNAL(triggered()), this, SLOT(displayInfo()));
 	QObject::connect(this->ui->actionAbout, SIGNAL(triggered()), this, SLOT(displayAbout()));
 }
 
+void MainWindow::densityEdited() {
+	this->densityTyped = true;
+}
+
+void MainWindow::checkAuditLog() {
+	if(this->auditFailureShown || !this->auditLog->hasFailed()) {
+		return;
+	}
+	// once per session, the message would otherwise repeat for every calculation
+	this->auditFailureShown = true;
+	QMessageBox::warning(this, "Audit Trail",
+		QString("Calculations are no longer recorded completely.\n%1").arg(this->auditLog->errorString()));
+}
+
 void MainWindow::displayRules(std::map<QString, bool> settings) {
 	QStringList hidden;
 
@@ -136,6 +164,12 @@ MainWindow::~MainWindow() {
 	if(settingsDialog != nullptr) {
 		delete settingsDialog;
 	}
+	if(worksheetDialog != nullptr) {
+		delete worksheetDialog;
+	}
+	delete catalog;
+	delete auditLog;
+	delete densityTable;
     delete ui;
 	delete settings;
 }
@@ -155,15 +189,35 @@ void MainWindow::calculateReleaseLimits() {
 			throw std::runtime_error("The declared value has to be a number.\nPoint and comma may be used as decimal separator.");
 		}
 
-		QString densityStringValue = this->ui->editDensity->text();
-		densityStringValue.replace(',', '.');
-		double density = densityStringValue.toDouble(&no_error);
-		if(!no_error) {
-			this->ui->editDensity->setText("1.00");
-			density = 1.f;
+		double density;
+		// a typed density wins over the density table
+		QString densityText = this->ui->editDensity->text().trimmed();
+		bool densityTyped = this->densityTyped && !densityText.isEmpty();
+		if(this->ui->cbProduct->currentIndex() > 0 && !densityTyped) {
+			double temperature = DensityTable::REFERENCE_TEMPERATURE;
+			if(!this->ui->editTemperature->text().isEmpty()) {
+				temperature = parseDecimal(this->ui->editTemperature->text(), &no_error);
+				if(!no_error) {
+					throw std::runtime_error("The temperature has to be a number.");
+				}
+			}
+			density = this->densityTable->lookup(this->ui->cbProduct->currentIndex() - 1, temperature);
+			if(density <= 0) {
+				throw std::runtime_error(QString("The density table has no density of %1 at %2%3C.")
+					.arg(this->ui->cbProduct->currentText()).arg(temperature).arg(QChar(0xB0)).toStdString());
+			}
+			this->ui->editDensity->setText(QString::number(density, 'f', 4));
+			this->densityTyped = false;
+		} else {
+			density = parseDecimal(densityText, &no_error);
+			if(!no_error) {
+				this->ui->editDensity->setText("1.00");
+				this->densityTyped = false;
+				density = 1.f;
+			}
 		}
-		if(density <= 0) {
-			throw std::runtime_error("The density must be a positive value.");
+		if(!isValidDensity(density)) {
+			throw std::runtime_error("The density must be a positive value of at least 0.000001.");
 		}
 
 
@@ -177,8 +231,19 @@ void MainWindow::calculateReleaseLimits() {
 #endif
 		
 		ratio declared = ratio(declaredValue, percentWW ? Unit::PERCENT_WW : Unit::g_per_l);
-		for(auto it = this->rules->begin(); it != this->rules->end(); ++it) {
-			(*it)->update(declared, density, homogenous);
+		bool exact = this->settings->value("exactArithmetic", false).toBool();
+		BatchEvaluator evaluator(*this->rules, this->precision, this->auditLog, AuditSource::GUI, exact);
+		BatchSample sample;
+		sample.declared = declared;
+		sample.density = density;
+		sample.homogenous = homogenous;
+		const QString rangeError = evaluator.checkSample(sample);
+		if(!rangeError.isEmpty()) {
+			throw std::runtime_error(rangeError.toStdString());
+		}
+		BatchEvaluator::Result result = evaluator.evaluate(sample);
+		for(size_t i = 0; i < this->rules->size(); ++i) {
+			this->rules->at(i)->display(result.data() + evaluator.outputOffset(i), evaluator.outputCount(i), density, exact);
 		}
 	} catch(std::runtime_error &e) {
 		QMessageBox::critical(this, "Invalid Values", e.what());
@@ -190,9 +255,256 @@ void MainWindow::calculateReleaseLimits() {
 	}
 }
 
+/** Write messages as comment lines of semicolon separated output */
+static void writeComments(QTextStream &out, const QStringList &messages) {
+	for(auto it = messages.begin(); it != messages.end(); ++it) {
+		QStringList lines = it->split('\n');
+		for(auto line = lines.begin(); line != lines.end(); ++line) {
+			out << "# " << *line << "\n";
+		}
+	}
+}
+
+int MainWindow::runCommand(const QStringList &args, QString &output) {
+	return this->prepareCommand(args)(output);
+}
+
+MainWindow::CommandJob MainWindow::prepareCommand(const QStringList &args) {
+	if(args.contains("--show")) {
+		this->show();
+		this->setWindowState(this->windowState() & ~Qt::WindowMinimized);
+		this->raise();
+		this->activateWindow();
+		return [](QString&) {return 0;};
+	}
+
+	try {
+		QStringList batchFiles;
+		QStringList ruleNames;
+		BatchSample single;
+		bool hasSingle = false;
+		// --inverse and --targets take measured values, the declared value of each sample is then the measured one
+		bool calculate = false;
+		bool inverse = false;
+		bool exact = this->settings->value("exactArithmetic", false).toBool();
+		bool exactRequested = false;
+		bool ok;
+
+		for(int i = 0; i < args.size(); ++i) {
+			const QString &arg = args.at(i);
+			bool hasValue = i + 1 < args.size();
+			if(arg == "--calc" && hasValue) {
+				double value = parseDecimal(args.at(++i), &ok);
+				if(!ok) {
+					throw std::runtime_error("The declared value has to be a number.");
+				}
+				single.declared = ratio(value, single.declared.getUnit());
+				hasSingle = true;
+				calculate = true;
+			} else if(arg == "--inverse" && hasValue) {
+				double value = parseDecimal(args.at(++i), &ok);
+				if(!ok) {
+					throw std::runtime_error("The measured value has to be a number.");
+				}
+				single.declared = ratio(value, single.declared.getUnit());
+				hasSingle = true;
+				inverse = true;
+			} else if(arg == "--unit" && hasValue) {
+				Unit unit = parseUnit(args.at(++i));
+				if(unit == Unit::INVALID) {
+					throw std::runtime_error("The unit must be \"g/l\" or \"%w/w\".");
+				}
+				single.declared = ratio(single.declared.getValue(), unit);
+			} else if(arg == "--density" && hasValue) {
+				single.density = parseDecimal(args.at(++i), &ok);
+				if(!ok || !isValidDensity(single.density)) {
+					throw std::runtime_error("The density must be a positive value of at least 0.000001.");
+				}
+				single.densityGiven = true;
+			} else if(arg == "--homogenous") {
+				single.homogenous = true;
+			} else if(arg == "--heterogenous") {
+				single.homogenous = false;
+			} else if(arg == "--exact") {
+				exact = true;
+				exactRequested = true;
+			} else if(arg == "--product" && hasValue) {
+				single.product = args.at(++i);
+			} else if(arg == "--temperature" && hasValue) {
+				single.temperature = parseDecimal(args.at(++i), &ok);
+				if(!ok) {
+					throw std::runtime_error("The temperature has to be a number.");
+				}
+			} else if(arg == "--rule" && hasValue) {
+				ruleNames.append(args.at(++i));
+			} else if(arg == "--batch" && hasValue) {
+				batchFiles.append(args.at(++i));
+				calculate = true;
+			} else if(arg == "--targets" && hasValue) {
+				batchFiles.append(args.at(++i));
+				inverse = true;
+			} else {
+				throw std::runtime_error(QString("Unknown or incomplete argument %1.").arg(arg).toStdString());
+			}
+		}
+		if(hasSingle) {
+			std::vector<BatchSample> one(1, single);
+			if(!resolveDensities(one, this->densityTable).empty()) {
+				throw std::runtime_error(QString("The density table has no density of %1 at %2%3C.")
+					.arg(single.product).arg(single.temperature).arg(QChar(0xB0)).toStdString());
+			}
+			single = one.front();
+		}
+		if(calculate && inverse) {
+			throw std::runtime_error("--calc and --batch cannot be combined with --inverse or --targets.");
+		}
+		if(exactRequested && inverse) {
+			// the limits are solved for in floating point, there is no exact inverse
+			throw std::runtime_error("--exact cannot be combined with --inverse or --targets.");
+		}
+		if(!hasSingle && batchFiles.isEmpty()) {
+			throw std::runtime_error("Nothing to calculate, use --calc <value>, --batch <file>, --inverse <value> or --targets <file>.");
+		}
+
+		// rules are widgets and are loaded here, on the GUI thread; the job only uses snapshots of them
+		QStringList warnings;
+		std::shared_ptr<const InverseSolver> solver;
+		std::shared_ptr<const BatchEvaluator> evaluator;
+		if(inverse) {
+			solver = std::make_shared<const InverseSolver>(this->selectRules(ruleNames, warnings));
+			if(exact) {
+				warnings.append("Exact arithmetic is not available for inverse limits, they are solved in floating point.");
+			}
+		} else {
+			evaluator = std::make_shared<const BatchEvaluator>(this->createBatchEvaluator(ruleNames, AuditSource::BATCH, exact, warnings));
+		}
+		const DensityTable *densities = this->densityTable;
+		AuditLog *auditLog = this->auditLog;
+		const unsigned int precision = this->precision;
+
+		return [=](QString &output) -> int {
+			QTextStream out(&output);
+			try {
+				std::vector<BatchSample> samples;
+				if(hasSingle) {
+					samples.push_back(single);
+				}
+				for(auto file = batchFiles.begin(); file != batchFiles.end(); ++file) {
+					std::vector<BatchSample> batch = readBatchFile(*file, densities);
+					samples.insert(samples.end(), batch.begin(), batch.end());
+				}
+				if(samples.empty()) {
+					throw std::runtime_error("Nothing to calculate, the files have no samples.");
+				}
+
+				if(solver) {
+					writeComments(out, warnings);
+					out << InverseSolver::header();
+					for(size_t i = 0; i < samples.size(); ++i) {
+						noteAssumedDensity(out, static_cast<int>(i + 1), samples[i]);
+						InverseSolver::format(out, static_cast<int>(i + 1), samples[i].declared,
+							solver->solve(samples[i].declared, samples[i].density, samples[i].homogenous), precision);
+					}
+					return 0;
+				}
+				for(size_t i = 0; i < samples.size(); ++i) {
+					const QString rangeError = evaluator->checkSample(samples[i]);
+					if(!rangeError.isEmpty()) {
+						throw std::runtime_error(QString("Sample %1: %2").arg(i + 1).arg(rangeError).toStdString());
+					}
+				}
+				std::vector<BatchEvaluator::Result> results(samples.size());
+				evaluator->evaluate(samples.data(), samples.size(), results.data());
+				writeComments(out, warnings);
+				out << BatchEvaluator::header();
+				for(size_t i = 0; i < samples.size(); ++i) {
+					evaluator->format(out, static_cast<int>(i + 1), samples[i], results[i]);
+				}
+				if(!auditLog->flush()) {
+					writeComments(out, QStringList(auditLog->errorString()));
+					return 1;
+				}
+			} catch(std::runtime_error &e) {
+				out << e.what() << "\n";
+				return 1;
+			}
+			return 0;
+		};
+	} catch(std::runtime_error &e) {
+		const QString message = e.what();
+		return [message](QString &output) -> int {
+			QTextStream(&output) << message << "\n";
+			return 1;
+		};
+	}
+}
+
+BatchEvaluator MainWindow::createBatchEvaluator(const QStringList &ruleNames, AuditSource source, bool exact, QStringList &warnings) {
+	return BatchEvaluator(this->selectRules(ruleNames, warnings), this->precision, this->auditLog, source, exact, this->densityTable);
+}
+
+MainWindow::RuleVector MainWindow::selectRules(const QStringList &ruleNames, QStringList &warnings) {
+	if(!ruleNames.isEmpty()) {
+		// hidden rules are loaded on first use; other rules of a damaged file do not matter here
+		QStringList loadWarnings = this->loadRules(ruleNames);
+		QStringList missing;
+		for(auto it = ruleNames.begin(); it != ruleNames.end(); ++it) {
+			if(!this->catalog->isLoaded(*it)) {
+				missing.append(*it);
+			}
+		}
+		if(!missing.isEmpty()) {
+			loadWarnings.prepend(QString("The rules %1 could not be loaded.").arg(missing.join(", ")));
+			throw std::runtime_error(loadWarnings.join("\n").toStdString());
+		}
+		warnings.append(loadWarnings);
+	}
+	RuleVector selected;
+	QStringList hidden = this->settings->value("hidden", "").toString().split(",");
+	for(auto it = this->rules->begin(); it != this->rules->end(); ++it) {
+		if(ruleNames.isEmpty() ? !hidden.contains((*it)->getName()) : ruleNames.contains((*it)->getName())) {
+			selected.push_back(*it);
+		}
+	}
+	return selected;
+}
+
+QStringList MainWindow::visibleRules(const QStringList &hidden) const {
+	QStringList visible;
+	QStringList names = this->catalog->names();
+	for(auto it = names.begin(); it != names.end(); ++it) {
+		if(!hidden.contains(*it)) {
+			visible.append(*it);
+		}
+	}
+	return visible;
+}
+
+QStringList MainWindow::loadRules(const QStringList &names) {
+	QStringList warnings;
+	std::vector<ReleaseLimitsRule*> loaded = this->catalog->load(names, warnings);
+	for(auto it = loaded.begin(); it != loaded.end(); ++it) {
+		(*it)->updatePrecision(this->precision);
+	}
+	if(!loaded.empty()) {
+		*this->rules = this->catalog->loadedRules();
+	}
+	this->auditLog->setRuleSetHash(this->catalog->getHash());
+	return warnings;
+}
+
+void MainWindow::showRuleWarnings(const QStringList &warnings) {
+	for(auto it = warnings.begin(); it != warnings.end(); ++it) {
+		QMessageBox::warning(this, "Erroneous Configuration", *it);
+	}
+}
+
 void MainWindow::clearAll() {
 	this->ui->editDeclaredContent->clear();
 	this->ui->editDensity->clear();
+	this->densityTyped = false;
+	this->ui->cbProduct->setCurrentIndex(0);
+	this->ui->editTemperature->clear();
 	this->ui->rGrammsPerLiter->setChecked(true);
 	this->ui->rHomogenous->setChecked(true);
 	for(auto it = this->rules->begin(); it != this->rules->end(); ++it) {
@@ -203,7 +515,8 @@ void MainWindow::clearAll() {
 void MainWindow::displayInfo() {
 	QString info("To calculate the release limits specify all values in the input area, then click 'Calculate Release Limits'. "
 		"To update the calculation change any value in the input area, then click 'Calculate Release Limits' to update the output values. "
-		"If the density is not specified, 1.00g/ml will be used!\n\n"
+		"If the density is not specified, 1.00g/ml will be used! "
+		"If a product is selected, its density is taken from the density table at the given temperature (20%2C if left blank).\n\n"
 		"All calculations are performed at a precision of 6 to 9 digits. Output values are rounded to two decimal places.\n\n");
 
 	{
@@ -224,7 +537,9 @@ void MainWindow::displayAbout() {
 	QString msg = QString("Version 1.1 (2014-07-21)\n\n"
 		"Written by David Korzeniewski, %1 2013\n\n"
 		"Released under GNU GPLv3\nwww.gnu.org/licenses/gpl-3.0.html\n\n"
-		"Source code available at:\nhttps://github.com/cody42/ReleaseLimitsCalculator").arg(QChar(0xA9));
+		"Source code available at:\nhttps://github.com/cody42/ReleaseLimitsCalculator\n\n"
+		"%2 rules loaded, largest rule %3 bytes, compiled rules %4 bytes.").arg(QChar(0xA9))
+		.arg(this->rules->size()).arg(this->catalog->peakRuleSize()).arg(this->catalog->memoryUsage());
 	QMessageBox::about(this, "About Release Limits Calculator", msg);
 }
 
@@ -233,8 +548,9 @@ void MainWindow::displaySettings() {
 	
 	QStringList hidden = this->settings->value("hidden", "").toString().split(",");
 
-	for(auto it = this->rules->begin(); it != this->rules->end(); ++it) {
-		currentSettings.insert(std::make_pair(QString((*it)->getName()), !hidden.contains((*it)->getName())));
+	QStringList names = this->catalog->names();
+	for(auto it = names.begin(); it != names.end(); ++it) {
+		currentSettings.insert(std::make_pair(*it, !hidden.contains(*it)));
 	}
 
 	
@@ -255,6 +571,22 @@ void MainWindow::displaySettings() {
 	this->settingsDialog->show();
 }
 
+void MainWindow::displayWorksheet() {
+	if(this->worksheetDialog == nullptr) {
+		// the factory is called on the GUI thread when the worksheet is evaluated
+		this->worksheetDialog = new WorksheetDialog([this]() -> std::shared_ptr<const BatchEvaluator> {
+			bool exact = this->settings->value("exactArithmetic", false).toBool();
+			QStringList warnings;
+			auto evaluator = std::make_shared<const BatchEvaluator>(this->createBatchEvaluator(QStringList(), AuditSource::WORKSHEET, exact, warnings));
+			this->showRuleWarnings(warnings);
+			return evaluator;
+		}, this->densityTable);
+	}
+	this->worksheetDialog->show();
+	this->worksheetDialog->raise();
+	this->worksheetDialog->activateWindow();
+}
+
 void MainWindow::applySettings() {
 	if(this->settingsDialog !=nullptr) {
 		auto map = this->settingsDialog->getShowHideMap();
@@ -266,11 +598,14 @@ void MainWindow::applySettings() {
 			}
 		}
 		this->settings->setValue("hidden", hidden.join(','));
+		// rules shown for the first time are loaded now
+		this->showRuleWarnings(this->loadRules(this->visibleRules(hidden)));
 		this->displayRules(hidden);
 
 		
 		unsigned int precision = this->settingsDialog->getPrecisionSetting();
 		this->settings->setValue("precision", precision);
+		this->precision = precision;
 		
 		for(auto it = this->rules->begin(); it != this->rules->end(); ++it) {
 			(*it)->updatePrecision(precision);
@@ -3,10 +3,17 @@
 
 #include <QMainWindow>
 #include <QtCore/qsettings.h>
+#include <functional>
+#include <memory>
 #include <vector>
 
 #include "ReleaseLimitsRule.h"
 #include "SettingsDialog.h"
+#include "AuditLog.h"
+#include "BatchSample.h"
+#include "WorksheetDialog.h"
+#include "RuleCatalog.h"
+#include "InverseSolver.h"
 
 namespace Ui {
 class MainWindow;
@@ -22,6 +29,25 @@ public:
     explicit MainWindow(QWidget *parent = 0);
     ~MainWindow();
 
+	/** Execute command line arguments, either of this process or forwarded from another one
+	\param args the arguments without the program name
+	\param output receives the results as semicolon separated values or an error message
+	\return the exit code
+	*/
+	int runCommand(const QStringList &args, QString &output);
+	/** Runs a prepared command, see prepareCommand() */
+	typedef std::function<int(QString&)> CommandJob;
+	/** Parse the arguments and load the rules, which has to happen on the GUI thread.
+	The job reads the batch files, calculates and formats; it may run on any thread
+	while the window is alive. Errors in the arguments are reported by the job.
+	*/
+	CommandJob prepareCommand(const QStringList &args);
+	/** Evaluator for the given rules, all visible rules if ruleNames is empty
+	\param warnings receives the problems with rule files that did not affect the given rules
+	\throws std::runtime_error if one of the given rules could not be loaded
+	*/
+	BatchEvaluator createBatchEvaluator(const QStringList &ruleNames, AuditSource source, bool exact, QStringList &warnings);
+
 public slots:
 	void calculateReleaseLimits();
 	void clearAll();
@@ -30,14 +56,42 @@ public slots:
 	void displayInfo();
 	void displayAbout();
 	void displaySettings();
+	void displayWorksheet();
+private slots:
+	/** Warn once if the audit log lost records */
+	void checkAuditLog();
+	/** The user changed the density field, see densityTyped */
+	void densityEdited();
 protected:
 	void displayRules(std::map<QString, bool> settings);
 	void displayRules(QStringList hidden);
+	/** Names of all rules of the catalogue that are not hidden */
+	QStringList visibleRules(const QStringList &hidden) const;
+	/** Load the named rules if they are not loaded yet
+	\return a message for every rule or file that could not be loaded
+	*/
+	QStringList loadRules(const QStringList &names);
+	void showRuleWarnings(const QStringList &warnings);
+	/** The given rules, loading them if necessary, or all visible rules if ruleNames is empty
+	\param warnings receives the problems with rule files that did not affect the given rules
+	\throws std::runtime_error if one of the given rules could not be loaded
+	*/
+	RuleVector selectRules(const QStringList &ruleNames, QStringList &warnings);
 private:
     Ui::MainWindow *ui;
 	RuleVector *rules;
 	SettingsDialog *settingsDialog;
+	WorksheetDialog *worksheetDialog;
+	RuleCatalog *catalog;
 	QSettings *settings;
+	AuditLog *auditLog;
+	DensityTable *densityTable;
+	/** the user edited the density field since the program last filled it (table density or default) */
+	bool densityTyped;
+	bool auditFailureShown;
+	unsigned int precision;
+
+	static const int AUDIT_CHECK_MSECS = 2000;
 };
 
 #endif // MAINWINDOW_H